@@ -0,0 +1,203 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "arena.h"
+
+#define LARGE_CLASS 0xffu
+#define OFFSET_MASK 0xffffffffull
+
+// Header in front of every block, offsets handed out point just past it
+typedef struct {
+    uint32_t sizeClass;  // Index into the size classes, or LARGE_CLASS
+    uint32_t next;       // Next free block while on a free list
+    uint64_t size;       // Whole block including this header
+} ArenaBlock;
+
+static ArenaBlock *blockAt(Arena *arena, uint32_t offset) {
+    return (ArenaBlock *)((char *)arena + offset);
+}
+
+static uint32_t classSize(int sizeClass) {
+    return 1u << (sizeClass + ARENA_MIN_CLASS_SHIFT);
+}
+
+static void arenaName(int serverPID, char *name) {
+    snprintf(name, 64, ARENA_NAME_FORMAT, serverPID);
+}
+
+static Arena *mapArena(int serverPID, int create) {
+    char name[64];
+    arenaName(serverPID, name);
+
+    int fd = shm_open(name, O_RDWR | (create ? O_CREAT | O_TRUNC : 0), S_IRUSR | S_IWUSR);
+    if (fd < 0)
+        return NULL;
+    if (create && ftruncate(fd, ARENA_SIZE) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    Arena *arena = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return arena == MAP_FAILED ? NULL : arena;
+}
+
+Arena *arenaCreate(void) {
+    Arena *arena = mapArena(getpid(), 1);
+    if (arena == NULL)
+        return NULL;
+
+    // Blocks start on a 64 byte boundary after the header, offset 0 means "no block"
+    arena->size = ARENA_SIZE;
+    atomic_init(&arena->bump, (sizeof(Arena) + 63) & ~63u);
+    atomic_flag_clear(&arena->largeLock);
+    arena->magic = ARENA_MAGIC;
+    return arena;
+}
+
+Arena *arenaAttach(int serverPID) {
+    Arena *arena = mapArena(serverPID, 0);
+    if (arena != NULL && arena->magic != ARENA_MAGIC) {
+        munmap(arena, ARENA_SIZE);
+        return NULL;
+    }
+    return arena;
+}
+
+void arenaRemove(void) {
+    char name[64];
+    arenaName(getpid(), name);
+    shm_unlink(name);
+}
+
+static uint32_t bumpAlloc(Arena *arena, uint32_t size) {
+    uint32_t start = atomic_load(&arena->bump);
+    do {
+        if (size > ARENA_SIZE || start > ARENA_SIZE - size)
+            return 0;
+    } while (!atomic_compare_exchange_weak(&arena->bump, &start, start + size));
+    return start;
+}
+
+// Treiber stack operations, the tag in the high half defeats ABA between pop and CAS
+static void pushChain(Arena *arena, int sizeClass, uint32_t first, ArenaBlock *last) {
+    atomic_uint_fast64_t *head = &arena->classHeads[sizeClass];
+    uint64_t old = atomic_load(head);
+    do {
+        last->next = (uint32_t)(old & OFFSET_MASK);
+    } while (!atomic_compare_exchange_weak(head, &old, ((old >> 32) + 1) << 32 | first));
+}
+
+static uint32_t pop(Arena *arena, int sizeClass) {
+    atomic_uint_fast64_t *head = &arena->classHeads[sizeClass];
+    uint64_t old = atomic_load(head);
+    uint32_t offset;
+    do {
+        offset = (uint32_t)(old & OFFSET_MASK);
+        if (offset == 0)
+            return 0;
+        // next may be stale if another process pops this block first, the CAS then fails
+    } while (!atomic_compare_exchange_weak(head, &old, ((old >> 32) + 1) << 32 | blockAt(arena, offset)->next));
+    return offset;
+}
+
+static uint32_t allocSmall(Arena *arena, int sizeClass) {
+    uint32_t offset = pop(arena, sizeClass);
+    if (offset != 0)
+        return offset;
+
+    // Carve a new slab: keep its first block, put the rest on the free list in one CAS
+    uint32_t slab = bumpAlloc(arena, ARENA_SLAB_SIZE);
+    if (slab == 0)
+        return 0;
+
+    uint32_t size = classSize(sizeClass);
+    uint32_t count = ARENA_SLAB_SIZE / size;
+    for (uint32_t i = 0; i < count; i++) {
+        ArenaBlock *block = blockAt(arena, slab + i * size);
+        block->sizeClass = sizeClass;
+        block->size = size;
+        block->next = i + 1 < count ? slab + (i + 1) * size : 0;
+    }
+    if (count > 1)
+        pushChain(arena, sizeClass, slab + size, blockAt(arena, slab + (count - 1) * size));
+    return slab;
+}
+
+static uint32_t allocLarge(Arena *arena, uint64_t size) {
+    size = (size + ARENA_LARGE_ALIGN - 1) & ~(uint64_t)(ARENA_LARGE_ALIGN - 1);
+
+    // First fit over the freed large blocks
+    while (atomic_flag_test_and_set_explicit(&arena->largeLock, memory_order_acquire))
+        ;
+    uint32_t *link = &arena->largeFree;
+    while (*link != 0 && blockAt(arena, *link)->size < size)
+        link = &blockAt(arena, *link)->next;
+    uint32_t offset = *link;
+    if (offset != 0)
+        *link = blockAt(arena, offset)->next;
+    atomic_flag_clear_explicit(&arena->largeLock, memory_order_release);
+
+    if (offset == 0 && size <= UINT32_MAX) {
+        offset = bumpAlloc(arena, (uint32_t)size);
+        if (offset != 0) {
+            blockAt(arena, offset)->sizeClass = LARGE_CLASS;
+            blockAt(arena, offset)->size = size;
+        }
+    }
+    return offset;
+}
+
+uint32_t arenaAlloc(Arena *arena, size_t size) {
+    uint64_t needed = (uint64_t)size + sizeof(ArenaBlock);
+    uint32_t offset;
+
+    int sizeClass = 0;
+    while (sizeClass < ARENA_CLASSES && classSize(sizeClass) < needed)
+        sizeClass++;
+
+    if (sizeClass < ARENA_CLASSES)
+        offset = allocSmall(arena, sizeClass);
+    else
+        offset = allocLarge(arena, needed);
+    return offset != 0 ? offset + sizeof(ArenaBlock) : 0;
+}
+
+void arenaFree(Arena *arena, uint32_t offset) {
+    if (arenaPointer(arena, offset, 0) == NULL)
+        return;
+
+    uint32_t blockOffset = offset - sizeof(ArenaBlock);
+    ArenaBlock *block = blockAt(arena, blockOffset);
+    if (block->sizeClass != LARGE_CLASS) {
+        pushChain(arena, block->sizeClass, blockOffset, block);
+        return;
+    }
+
+    while (atomic_flag_test_and_set_explicit(&arena->largeLock, memory_order_acquire))
+        ;
+    block->next = arena->largeFree;
+    arena->largeFree = blockOffset;
+    atomic_flag_clear_explicit(&arena->largeLock, memory_order_release);
+}
+
+void *arenaPointer(Arena *arena, uint32_t offset, size_t size) {
+    // Offsets come from another process, so check them against the block they claim to be
+    if (offset < sizeof(Arena) + sizeof(ArenaBlock) || offset >= ARENA_SIZE)
+        return NULL;
+
+    ArenaBlock *block = blockAt(arena, offset - sizeof(ArenaBlock));
+    if (block->sizeClass != LARGE_CLASS && (block->sizeClass >= ARENA_CLASSES || block->size != classSize(block->sizeClass)))
+        return NULL;
+    if (block->size < sizeof(ArenaBlock) || block->size - sizeof(ArenaBlock) < size ||
+        block->size > ARENA_SIZE - (offset - sizeof(ArenaBlock)))
+        return NULL;
+    return (char *)arena + offset;
+}
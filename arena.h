@@ -0,0 +1,44 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Shared-memory payload arena of one server, requests refer to its blocks by offset
+#define ARENA_NAME_FORMAT "/ipc_calc_arena_%d"
+#define ARENA_SIZE (64u << 20)
+#define ARENA_MAGIC 0x41524e31u  // "ARN1"
+
+// Size classes are powers of two from 64 bytes to 64 KiB, carved out of 256 KiB slabs.
+// Anything bigger is a large block, rounded to 4 KiB and kept on a first-fit free list
+#define ARENA_CLASSES 11
+#define ARENA_MIN_CLASS_SHIFT 6
+#define ARENA_SLAB_SIZE (256u << 10)
+#define ARENA_LARGE_ALIGN 4096u
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+    atomic_uint_fast64_t classHeads[ARENA_CLASSES];  // Free lists: ABA tag << 32 | block offset
+    atomic_uint bump;                                // Start of never-used space
+    atomic_flag largeLock;                           // Guards largeFree, large blocks are rare
+    uint32_t largeFree;
+} Arena;
+
+// Create the arena of this server, or attach to the one of serverPID. NULL on failure
+Arena *arenaCreate(void);
+Arena *arenaAttach(int serverPID);
+void arenaRemove(void);
+
+// Allocate a payload of size bytes, returns its offset or 0 when the arena is exhausted
+uint32_t arenaAlloc(Arena *arena, size_t size);
+void arenaFree(Arena *arena, uint32_t offset);
+
+// Pointer to the payload at offset, NULL unless a block of at least size bytes starts there
+void *arenaPointer(Arena *arena, uint32_t offset, size_t size);
+
+#endif
@@ -0,0 +1,628 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "bulk.h"
+#include "calc.h"
+#include "codec.h"
+
+// Offline mode: ./bulk <input> <output>, every record of the input file is computed with the
+// server's calculation core and written to the same record slot of a preallocated output file.
+// BULK_WORKERS overrides the number of worker processes, one per core by default
+
+typedef struct {
+    const char *input;
+    char *output;
+    int inputFile, outputFile;  // Streamed jobs, which map neither
+    int workers;
+    size_t units;
+    size_t unitSize;
+    size_t *unitStart;      // units + 1 entries. Text: byte offsets just after a newline. Binary: record indexes
+    size_t *firstRecord;    // Shared with the workers, records before each unit
+    unsigned char *done;    // Shared mapping of the checkpoint bitmap
+    const int32_t *column[BULK_INPUT_COLUMNS];  // Columnar input
+    int32_t *result;
+    int32_t *status;
+} BulkJob;
+
+// Fill one fixed-width slot, right-aligned and ending in a newline
+void bulkFormatRecord(char *slot, int isValid, int value) {
+    char *end = slot + BULK_TEXT_WIDTH - 1;
+    *end = '\n';
+
+    char *start;
+    if (isValid) {
+        start = codecFormatBackward(value, end);
+    } else {
+        start = end - strlen(BULK_ERROR_TEXT);
+        memcpy(start, BULK_ERROR_TEXT, strlen(BULK_ERROR_TEXT));
+    }
+    memset(slot, ' ', start - slot);
+}
+
+static size_t countLines(const char *begin, const char *end) {
+    size_t count = 0;
+    for (const char *next = begin; (next = memchr(next, '\n', end - next)) != NULL; next++)
+        count++;
+    // A last line without a newline is still a record
+    if (end > begin && end[-1] != '\n')
+        count++;
+    return count;
+}
+
+size_t bulkProcessText(const char *begin, const char *end, char *output) {
+    const char *line = begin;
+    size_t count = 0;
+    while (line < end) {
+        const char *lineEnd = memchr(line, '\n', end - line);
+        if (lineEnd == NULL)
+            lineEnd = end;
+
+        // "num1 op num2 [modulus]", anything else in the line makes the record invalid
+        int operand[4] = { 0, 0, 0, 0 };
+        int fields = codecParseInts(line, lineEnd, operand, 4);
+
+        int result = 0;
+        int isValid = fields >= 3 &&
+                      computeOperation(operand[0], operand[1], operand[2], operand[3], &result) == 0;
+        bulkFormatRecord(output, isValid, result);
+        output += BULK_TEXT_WIDTH;
+        line = lineEnd + 1;
+        count++;
+    }
+    return count;
+}
+
+void bulkProcessBinary(const BulkRecord *records, size_t count, BulkResult *output) {
+    for (size_t i = 0; i < count; i++) {
+        const BulkRecord *record = &records[i];
+        output[i].result = 0;
+        output[i].status = computeOperation(record->num1, record->operation, record->num2, record->modulus,
+                                            &output[i].result);
+    }
+}
+
+// Worker w takes an even share of the units
+static size_t firstUnit(BulkJob *job, int w) {
+    return job->units * w / job->workers;
+}
+
+static int isUnitDone(BulkJob *job, size_t unit) {
+    return (__atomic_load_n(&job->done[unit / 8], __ATOMIC_ACQUIRE) >> (unit % 8)) & 1;
+}
+
+// A unit's results reach the disk before its bit is set, so a set bit can always be trusted.
+// The bitmap itself is written back lazily, losing a bit only means computing that unit again
+static void syncOutput(char *output, size_t size) {
+    if (size == 0)
+        return;
+    long page = sysconf(_SC_PAGESIZE);
+    char *start = (char *)((uintptr_t)output & ~(uintptr_t)(page - 1));
+    msync(start, output + size - start, MS_SYNC);
+}
+
+static void markUnitDone(BulkJob *job, size_t unit) {
+    __atomic_fetch_or(&job->done[unit / 8], (unsigned char)(1 << (unit % 8)), __ATOMIC_RELEASE);
+}
+
+// Records in a row that share the operation, and the modulus where it matters, go through one
+// computeBatch call straight on the columns. A run with an invalid record is redone one by one
+// so only that record gets the error
+static void processColumns(BulkJob *job, size_t first, size_t last) {
+    const int32_t *num1 = job->column[BULK_COLUMN_NUM1], *operation = job->column[BULK_COLUMN_OPERATION];
+    const int32_t *num2 = job->column[BULK_COLUMN_NUM2], *modulus = job->column[BULK_COLUMN_MODULUS];
+
+    size_t end;
+    for (size_t i = first; i < last; i = end) {
+        int isModular = operation[i] == OP_MULMOD || operation[i] == OP_POWMOD;
+        for (end = i + 1; end < last && operation[end] == operation[i] && (!isModular || modulus[end] == modulus[i]); end++)
+            ;
+
+        if (computeBatch(num1 + i, operation[i], num2 + i, modulus[i], job->result + i, end - i) == 0) {
+            memset(job->status + i, 0, (end - i) * sizeof(int32_t));
+            continue;
+        }
+        for (size_t j = i; j < end; j++) {
+            job->result[j] = 0;
+            job->status[j] = computeOperation(num1[j], operation[j], num2[j], modulus[j], &job->result[j]);
+        }
+    }
+}
+
+static void countChunk(BulkJob *job, int w) {
+    for (size_t u = firstUnit(job, w); u < firstUnit(job, w + 1); u++)
+        job->firstRecord[u] = countLines(job->input + job->unitStart[u], job->input + job->unitStart[u + 1]);
+}
+
+static void processTextChunk(BulkJob *job, int w) {
+    for (size_t u = firstUnit(job, w); u < firstUnit(job, w + 1); u++) {
+        if (isUnitDone(job, u))
+            continue;
+        char *output = job->output + job->firstRecord[u] * BULK_TEXT_WIDTH;
+        bulkProcessText(job->input + job->unitStart[u], job->input + job->unitStart[u + 1], output);
+        syncOutput(output, (job->firstRecord[u + 1] - job->firstRecord[u]) * BULK_TEXT_WIDTH);
+        markUnitDone(job, u);
+    }
+}
+
+static void processBinaryChunk(BulkJob *job, int w) {
+    const BulkRecord *records = (const BulkRecord *)(job->input + BULK_MAGIC_SIZE);
+    BulkResult *results = (BulkResult *)(job->output + BULK_MAGIC_SIZE);
+    for (size_t u = firstUnit(job, w); u < firstUnit(job, w + 1); u++) {
+        if (isUnitDone(job, u))
+            continue;
+        size_t first = job->unitStart[u], last = job->unitStart[u + 1];
+        bulkProcessBinary(records + first, last - first, results + first);
+        syncOutput((char *)(results + first), (last - first) * sizeof(BulkResult));
+        markUnitDone(job, u);
+    }
+}
+
+static void processColumnsChunk(BulkJob *job, int w) {
+    for (size_t u = firstUnit(job, w); u < firstUnit(job, w + 1); u++) {
+        if (isUnitDone(job, u))
+            continue;
+        size_t first = job->unitStart[u], last = job->unitStart[u + 1];
+        processColumns(job, first, last);
+
+        // The two result columns are apart, each range is flushed on its own
+        syncOutput((char *)(job->result + first), (last - first) * sizeof(int32_t));
+        syncOutput((char *)(job->status + first), (last - first) * sizeof(int32_t));
+        markUnitDone(job, u);
+    }
+}
+
+// Streamed text, first pass: the lines of each unit, read in blocks and dropped from the cache
+static void countStreamedChunk(BulkJob *job, int w) {
+    char *buffer = malloc(BULK_STREAM_BLOCK);
+    if (buffer == NULL) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+    for (size_t u = firstUnit(job, w); u < firstUnit(job, w + 1); u++) {
+        size_t lines = 0, start = job->unitStart[u], end = job->unitStart[u + 1];
+        char last = '\n';
+        for (size_t offset = start; offset < end;) {
+            size_t length = end - offset < BULK_STREAM_BLOCK ? end - offset : BULK_STREAM_BLOCK;
+            ssize_t bytesRead = pread(job->inputFile, buffer, length, offset);
+            if (bytesRead <= 0) {
+                perror("ERROR_FROM_EX2\n");
+                exit(-1);
+            }
+            for (const char *next = buffer; (next = memchr(next, '\n', buffer + bytesRead - next)) != NULL; next++)
+                lines++;
+            last = buffer[bytesRead - 1];
+            offset += bytesRead;
+        }
+        // Only the last unit can end without a newline, that line is still a record
+        job->firstRecord[u] = lines + (last != '\n');
+        posix_fadvise(job->inputFile, start, end - start, POSIX_FADV_DONTNEED);
+    }
+    free(buffer);
+}
+
+// Each unit goes through the double buffers on its own and is marked once its results are on
+// the disk. A unit that doesn't come out at the counted size means the input changed
+static void streamChunk(BulkJob *job, int w, int isBinary) {
+    BulkStream *stream = NULL;
+    for (size_t u = firstUnit(job, w); u < firstUnit(job, w + 1); u++) {
+        if (isUnitDone(job, u))
+            continue;
+        if (stream == NULL)
+            stream = bulkStreamOpen(job->inputFile, job->outputFile);
+
+        // Binary units are record indexes, text units are byte offsets with their first record apart
+        size_t first, last, count;
+        if (isBinary) {
+            first = job->unitStart[u];
+            last = job->unitStart[u + 1];
+            count = bulkStreamRange(stream, BULK_MAGIC_SIZE + first * sizeof(BulkRecord),
+                                    BULK_MAGIC_SIZE + last * sizeof(BulkRecord),
+                                    BULK_MAGIC_SIZE + first * sizeof(BulkResult), 1);
+        } else {
+            first = job->firstRecord[u];
+            last = job->firstRecord[u + 1];
+            count = bulkStreamRange(stream, job->unitStart[u], job->unitStart[u + 1], first * BULK_TEXT_WIDTH, 0);
+        }
+        if (count != last - first) {
+            printf("ERROR_FROM_EX2 - input changed while it was processed\n");
+            exit(-1);
+        }
+        markUnitDone(job, u);
+    }
+}
+
+static void streamTextChunk(BulkJob *job, int w) {
+    streamChunk(job, w, 0);
+}
+
+static void streamBinaryChunk(BulkJob *job, int w) {
+    streamChunk(job, w, 1);
+}
+
+// Run work on every chunk, one forked worker per chunk and the parent takes the last one.
+// Workers write straight into the shared mappings, so there is nothing to merge afterwards
+static void runWorkers(BulkJob *job, void (*work)(BulkJob *, int)) {
+    pid_t pids[BULK_MAX_WORKERS];
+    for (int w = 0; w < job->workers - 1; w++) {
+        pids[w] = fork();
+        if (pids[w] == 0) {
+            work(job, w);
+            _exit(0);
+        }
+        if (pids[w] < 0)
+            work(job, w);  // No process to spare, do this chunk here
+    }
+    work(job, job->workers - 1);
+
+    for (int w = 0; w < job->workers - 1; w++) {
+        int status;
+        if (pids[w] > 0 && (waitpid(pids[w], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+            printf("ERROR_FROM_EX2 - bulk worker failed\n");
+            exit(-1);
+        }
+    }
+}
+
+static int workerCount(size_t size, size_t units) {
+    char *override = getenv("BULK_WORKERS");
+    long workers = override != NULL ? atol(override) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (override == NULL && (size_t)workers > size / BULK_CHUNK_MIN)
+        workers = size / BULK_CHUNK_MIN;
+    if ((size_t)workers > units)
+        workers = units;
+    if (workers < 1)
+        workers = 1;
+    return workers < BULK_MAX_WORKERS ? (int)workers : BULK_MAX_WORKERS;
+}
+
+static size_t *allocateUnits(size_t units) {
+    size_t *unitStart = malloc((units + 1) * sizeof(size_t));
+    if (unitStart == NULL) {
+        printf("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+    return unitStart;
+}
+
+// Units of BULK_UNIT_SIZE bytes, each end pushed forward past the next newline so no line is
+// split. They only depend on the input, so a resumed job gets the same units again
+static void splitText(BulkJob *job, size_t size) {
+    job->unitSize = BULK_UNIT_SIZE;
+    job->units = (size + BULK_UNIT_SIZE - 1) / BULK_UNIT_SIZE;
+    job->unitStart = allocateUnits(job->units);
+    job->unitStart[0] = 0;
+    for (size_t u = 1; u < job->units; u++) {
+        size_t start = u * (size_t)BULK_UNIT_SIZE;
+        if (start < job->unitStart[u - 1])
+            start = job->unitStart[u - 1];
+        const char *newline = start < size ? memchr(job->input + start, '\n', size - start) : NULL;
+        job->unitStart[u] = newline != NULL ? (size_t)(newline - job->input) + 1 : size;
+    }
+    job->unitStart[job->units] = size;
+}
+
+// Streamed text gets the same kind of units, each end found by reading on from where it would be
+static void splitStreamedText(BulkJob *job, size_t size) {
+    char buffer[BULK_STREAM_CARRY];
+    job->unitSize = BULK_STREAM_UNIT;
+    job->units = (size + BULK_STREAM_UNIT - 1) / BULK_STREAM_UNIT;
+    job->unitStart = allocateUnits(job->units);
+    job->unitStart[0] = 0;
+    for (size_t u = 1; u < job->units; u++) {
+        size_t start = u * (size_t)BULK_STREAM_UNIT;
+        if (start < job->unitStart[u - 1])
+            start = job->unitStart[u - 1];
+
+        ssize_t bytesRead = 0;
+        const char *newline = NULL;
+        while (start < size && (bytesRead = pread(job->inputFile, buffer, sizeof(buffer), start)) > 0 &&
+               (newline = memchr(buffer, '\n', bytesRead)) == NULL)
+            start += bytesRead;
+        if (bytesRead < 0) {
+            perror("ERROR_FROM_EX2\n");
+            exit(-1);
+        }
+        job->unitStart[u] = newline != NULL ? start + (newline - buffer) + 1 : size;
+    }
+    job->unitStart[job->units] = size;
+}
+
+static void splitBinary(BulkJob *job, size_t count, size_t unitSize) {
+    size_t perUnit = unitSize / sizeof(BulkRecord);
+    job->unitSize = unitSize;
+    job->units = (count + perUnit - 1) / perUnit;
+    job->unitStart = allocateUnits(job->units);
+    for (size_t u = 0; u < job->units; u++)
+        job->unitStart[u] = u * perUnit;
+    job->unitStart[job->units] = count;
+}
+
+// Map "<output>.ckpt", creating it empty unless the one left behind describes this same input.
+// Returns 1 when resuming an interrupted job
+static int openCheckpoint(BulkJob *job, const char *path, const struct stat *inputStat, int format) {
+    BulkCheckpoint expected;
+    memset(&expected, 0, sizeof(expected));
+    memcpy(expected.magic, BULK_CHECKPOINT_MAGIC, BULK_MAGIC_SIZE);
+    expected.inputSize = inputStat->st_size;
+    expected.inputInode = inputStat->st_ino;
+    expected.inputModified = (int64_t)inputStat->st_mtim.tv_sec * 1000000000 + inputStat->st_mtim.tv_nsec;
+    expected.units = job->units;
+    expected.unitSize = job->unitSize;
+    expected.format = format;
+
+    size_t size = sizeof(BulkCheckpoint) + (job->units + 7) / 8;
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    struct stat fileStat;
+    if (fd < 0 || fstat(fd, &fileStat) < 0) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+
+    BulkCheckpoint found;
+    int isResumed = (size_t)fileStat.st_size == size && pread(fd, &found, sizeof(found), 0) == sizeof(found) &&
+                    memcmp(&found, &expected, sizeof(found)) == 0;
+    if (!isResumed && (ftruncate(fd, 0) < 0 || ftruncate(fd, size) < 0 ||
+                       pwrite(fd, &expected, sizeof(expected), 0) != sizeof(expected))) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+
+    char *checkpoint = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (checkpoint == MAP_FAILED) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+    job->done = (unsigned char *)checkpoint + sizeof(BulkCheckpoint);
+    return isResumed;
+}
+
+static size_t unitsDone(BulkJob *job) {
+    size_t done = 0;
+    for (size_t u = 0; u < job->units; u++)
+        done += isUnitDone(job, u);
+    return done;
+}
+
+// Create the output file at its final size, the workers only fill slots in it. A resumed job
+// keeps what the finished units already wrote
+static int openOutput(const char *path, size_t size, int isResumed) {
+    int fd = open(path, O_RDWR | O_CREAT | (isResumed ? 0 : O_TRUNC), 0644);
+    if (fd < 0 || ftruncate(fd, size) < 0) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+    return fd;
+}
+
+static char *mapOutput(const char *path, size_t size, int isResumed) {
+    int fd = openOutput(path, size, isResumed);
+    if (size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    char *output = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (output == MAP_FAILED) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+    return output;
+}
+
+// Mapping a file much larger than the memory only thrashes the page cache. Columnar input is
+// always mapped, its columns are read far apart from each other
+static int isStreamed(int fd, size_t size) {
+    char magic[BULK_MAGIC_SIZE];
+    if (size >= BULK_MAGIC_SIZE && pread(fd, magic, BULK_MAGIC_SIZE, 0) == BULK_MAGIC_SIZE &&
+        memcmp(magic, BULK_COLUMNS_MAGIC, BULK_MAGIC_SIZE) == 0)
+        return 0;
+
+    char *override = getenv("BULK_STREAM");
+    if (override != NULL)
+        return strcmp(override, "1") == 0;
+    return size > (size_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / 2;
+}
+
+static size_t *mapRecordCounts(size_t units) {
+    size_t *firstRecord = mmap(NULL, sizeof(size_t) * (units + 1), PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (firstRecord == MAP_FAILED) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+    return firstRecord;
+}
+
+// Turn the record count of every unit into the index of its first record, returns the total
+static size_t sumRecords(BulkJob *job) {
+    size_t count = 0;
+    for (size_t u = 0; u < job->units; u++) {
+        size_t lines = job->firstRecord[u];
+        job->firstRecord[u] = count;
+        count += lines;
+    }
+    job->firstRecord[job->units] = count;
+    return count;
+}
+
+// An uncompressed input too large to map, split into units that the workers stream in
+// parallel into an output file created at its final size, checkpointed like a mapped job
+static size_t streamJob(BulkJob *job, const struct stat *inputStat, const char *inputPath, const char *outputPath,
+                        const char *checkpointPath) {
+    size_t inputSize = inputStat->st_size, count;
+    char magic[BULK_MAGIC_SIZE];
+    int isBinary = inputSize >= BULK_MAGIC_SIZE &&
+                   pread(job->inputFile, magic, BULK_MAGIC_SIZE, 0) == BULK_MAGIC_SIZE &&
+                   memcmp(magic, BULK_BINARY_MAGIC, BULK_MAGIC_SIZE) == 0;
+    size_t outputSize;
+    if (isBinary) {
+        if ((inputSize - BULK_MAGIC_SIZE) % sizeof(BulkRecord) != 0) {
+            printf("ERROR_FROM_EX2 - truncated binary record\n");
+            exit(-1);
+        }
+        count = (inputSize - BULK_MAGIC_SIZE) / sizeof(BulkRecord);
+        splitBinary(job, count, BULK_STREAM_UNIT);
+        job->workers = workerCount(inputSize, job->units);
+        outputSize = BULK_MAGIC_SIZE + count * sizeof(BulkResult);
+    } else {
+        // Output slots need the line counts first, one parallel pass over the input
+        splitStreamedText(job, inputSize);
+        job->workers = workerCount(inputSize, job->units);
+        job->firstRecord = mapRecordCounts(job->units);
+        runWorkers(job, countStreamedChunk);
+        count = sumRecords(job);
+        outputSize = count * BULK_TEXT_WIDTH;
+    }
+
+    int isResumed = openCheckpoint(job, checkpointPath, inputStat, isBinary ? BULK_FORMAT_BINARY : BULK_FORMAT_TEXT);
+    job->outputFile = openOutput(outputPath, outputSize, isResumed);
+    if (isBinary && pwrite(job->outputFile, BULK_RESULT_MAGIC, BULK_MAGIC_SIZE, 0) != BULK_MAGIC_SIZE) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+    if (isResumed)
+        printf("Bulk - Resuming '%s', %zu of %zu units already done.\n", inputPath, unitsDone(job), job->units);
+    runWorkers(job, isBinary ? streamBinaryChunk : streamTextChunk);
+    close(job->outputFile);
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        printf("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    struct stat fileStat;
+    if (fd < 0 || fstat(fd, &fileStat) < 0) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+
+    size_t inputSize = fileStat.st_size;
+    pid_t decompressor, compressor = 0;
+    int source = bulkDecompress(fd, &decompressor);
+    char *compression = getenv(BULK_COMPRESS_ENV);
+
+    BulkJob job;
+    char checkpointPath[4096];
+    snprintf(checkpointPath, sizeof(checkpointPath), "%s%s", argv[2], BULK_CHECKPOINT_SUFFIX);
+
+    // A compressed stream is only readable or writable in order, one process does all of it
+    if (decompressor != 0 || compression != NULL) {
+        printf("Bulk - Compressed jobs run in one process without a checkpoint, an interrupted one starts over.\n");
+        int output = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (output < 0) {
+            perror("ERROR_FROM_EX2\n");
+            exit(-1);
+        }
+        if (compression != NULL)
+            output = bulkCompress(output, compression, &compressor);
+
+        size_t count = bulkStream(source, decompressor != 0 ? BULK_SIZE_UNKNOWN : inputSize, output);
+        close(source);
+        close(output);  // The compressor sees the end of its input
+        bulkFinishFilter(decompressor);
+        bulkFinishFilter(compressor);
+        printf("Bulk - Streamed %zu records from '%s' into '%s'.\n", count, argv[1], argv[2]);
+        return 0;
+    }
+
+    if (isStreamed(fd, inputSize)) {
+        job.inputFile = fd;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        size_t count = streamJob(&job, &fileStat, argv[1], argv[2], checkpointPath);
+        unlink(checkpointPath);
+        printf("Bulk - Streamed %zu records from '%s' into '%s'.\n", count, argv[1], argv[2]);
+        return 0;
+    }
+
+    const char *input = "";
+    if (inputSize > 0) {
+        input = mmap(NULL, inputSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (input == MAP_FAILED) {
+            perror("ERROR_FROM_EX2\n");
+            exit(-1);
+        }
+        madvise((void *)input, inputSize, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    job.input = input;
+
+    size_t count;
+    int isResumed;
+    void (*process)(BulkJob *, int);
+    if (inputSize >= BULK_MAGIC_SIZE && memcmp(input, BULK_BINARY_MAGIC, BULK_MAGIC_SIZE) == 0) {
+        // Binary records in, binary results out, behind their own magic
+        if ((inputSize - BULK_MAGIC_SIZE) % sizeof(BulkRecord) != 0) {
+            printf("ERROR_FROM_EX2 - truncated binary record\n");
+            exit(-1);
+        }
+        count = (inputSize - BULK_MAGIC_SIZE) / sizeof(BulkRecord);
+        splitBinary(&job, count, BULK_UNIT_SIZE);
+        job.workers = workerCount(inputSize, job.units);
+        isResumed = openCheckpoint(&job, checkpointPath, &fileStat, BULK_FORMAT_BINARY);
+        job.output = mapOutput(argv[2], BULK_MAGIC_SIZE + count * sizeof(BulkResult), isResumed);
+        memcpy(job.output, BULK_RESULT_MAGIC, BULK_MAGIC_SIZE);
+        process = processBinaryChunk;
+    } else if (inputSize >= sizeof(BulkColumns) && memcmp(input, BULK_COLUMNS_MAGIC, BULK_MAGIC_SIZE) == 0) {
+        // Columns in, columns out, the kernels run on the mapped arrays without any parsing
+        const BulkColumns *header = (const BulkColumns *)input;
+        count = header->count;
+        for (int c = 0; c < BULK_INPUT_COLUMNS; c++) {
+            if (count > inputSize / sizeof(int32_t) || header->column[c] % sizeof(int32_t) != 0 ||
+                header->column[c] > inputSize - count * sizeof(int32_t)) {
+                printf("ERROR_FROM_EX2 - column outside the input file\n");
+                exit(-1);
+            }
+            job.column[c] = (const int32_t *)(input + header->column[c]);
+        }
+        splitBinary(&job, count, BULK_UNIT_SIZE);
+        job.workers = workerCount(inputSize, job.units);
+        isResumed = openCheckpoint(&job, checkpointPath, &fileStat, BULK_FORMAT_COLUMNS);
+        job.output = mapOutput(argv[2], bulkColumnOffset(count, BULK_RESULT_COLUMNS), isResumed);
+
+        BulkColumns *results = (BulkColumns *)job.output;
+        memset(results, 0, sizeof(BulkColumns));
+        memcpy(results->magic, BULK_COLUMN_RESULT_MAGIC, BULK_MAGIC_SIZE);
+        results->count = count;
+        results->column[BULK_COLUMN_RESULT] = bulkColumnOffset(count, BULK_COLUMN_RESULT);
+        results->column[BULK_COLUMN_STATUS] = bulkColumnOffset(count, BULK_COLUMN_STATUS);
+        job.result = (int32_t *)(job.output + results->column[BULK_COLUMN_RESULT]);
+        job.status = (int32_t *)(job.output + results->column[BULK_COLUMN_STATUS]);
+        process = processColumnsChunk;
+    } else {
+        // First pass counts the lines of every unit, their prefix sums are the output slots
+        splitText(&job, inputSize);
+        job.workers = workerCount(inputSize, job.units);
+        job.firstRecord = mapRecordCounts(job.units);
+        runWorkers(&job, countChunk);
+        count = sumRecords(&job);
+        isResumed = openCheckpoint(&job, checkpointPath, &fileStat, BULK_FORMAT_TEXT);
+        job.output = mapOutput(argv[2], count * BULK_TEXT_WIDTH, isResumed);
+        process = processTextChunk;
+    }
+
+    if (isResumed)
+        printf("Bulk - Resuming '%s', %zu of %zu units already done.\n", argv[1], unitsDone(&job), job.units);
+    runWorkers(&job, process);
+
+    // Finished, the checkpoint has nothing left to say
+    unlink(checkpointPath);
+    printf("Bulk - Processed %zu records from '%s' into '%s'.\n", count, argv[1], argv[2]);
+    return 0;
+}
@@ -0,0 +1,135 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#ifndef BULK_H
+#define BULK_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Binary input starts with this magic, anything else is read as "num1 op num2 [modulus]" lines
+#define BULK_BINARY_MAGIC "CALCBIN1"
+#define BULK_RESULT_MAGIC "CALCRES1"
+#define BULK_MAGIC_SIZE 8
+
+// Columnar input and results, one array per field behind a BulkColumns header
+#define BULK_COLUMNS_MAGIC "CALCCOL1"
+#define BULK_COLUMN_RESULT_MAGIC "CALCCOR1"
+#define BULK_COLUMN_ALIGN 64
+
+// Columns of an input file
+#define BULK_COLUMN_NUM1 0
+#define BULK_COLUMN_OPERATION 1
+#define BULK_COLUMN_NUM2 2
+#define BULK_COLUMN_MODULUS 3
+#define BULK_INPUT_COLUMNS 4
+
+// Columns of a result file
+#define BULK_COLUMN_RESULT 0
+#define BULK_COLUMN_STATUS 1
+#define BULK_RESULT_COLUMNS 2
+
+// Input formats, recorded in the checkpoint
+#define BULK_FORMAT_TEXT 0
+#define BULK_FORMAT_BINARY 1
+#define BULK_FORMAT_COLUMNS 2
+
+// Text results are fixed-width lines, so record i always starts at byte i * BULK_TEXT_WIDTH
+#define BULK_TEXT_WIDTH 16
+#define BULK_ERROR_TEXT "ERROR_FROM_EX2"
+
+// Inputs are split into one record-aligned chunk per core, chunks smaller than this aren't worth a worker
+#define BULK_MAX_WORKERS 64
+#define BULK_CHUNK_MIN (1 << 20)
+
+// Progress is recorded per checkpoint unit, about this many input bytes each, in a bitmap kept
+// in "<output>.ckpt". Running the same job again after an interruption skips the finished units
+#define BULK_UNIT_SIZE (4 << 20)
+#define BULK_CHECKPOINT_SUFFIX ".ckpt"
+#define BULK_CHECKPOINT_MAGIC "CALCCKP1"
+
+// Inputs larger than half of the memory are streamed through two buffers of BULK_STREAM_BLOCK
+// bytes instead of being mapped, BULK_STREAM=1 or 0 forces the choice. A text line can be at
+// most BULK_STREAM_CARRY bytes long there, it is carried over from one block to the next
+#define BULK_STREAM_BLOCK (2 << 20)
+#define BULK_STREAM_CARRY (64 << 10)
+
+// A streamed job is split into units of about BULK_STREAM_UNIT bytes, and every worker streams
+// its share of them through its own buffers. The checkpoint records them like mapped units
+#define BULK_STREAM_UNIT (64 << 20)
+
+typedef struct {
+    int32_t num1;
+    int32_t operation;
+    int32_t num2;
+    int32_t modulus;  // 0 for the operations that don't take one
+} BulkRecord;
+
+typedef struct {
+    int32_t result;
+    int32_t status;  // 0, or -1 if the record was invalid
+} BulkResult;
+
+// Header of a columnar file, each column is count int32 values starting at its byte offset.
+// Writers put them one after another at BULK_COLUMN_ALIGN boundaries, see bulkColumnOffset
+typedef struct {
+    char magic[BULK_MAGIC_SIZE];
+    uint64_t count;
+    uint64_t column[BULK_INPUT_COLUMNS];  // Result files use the first BULK_RESULT_COLUMNS
+    uint64_t reserved[2];
+} BulkColumns;
+
+static inline uint64_t bulkColumnOffset(uint64_t count, int column) {
+    uint64_t columnSize = (count * sizeof(int32_t) + BULK_COLUMN_ALIGN - 1) & ~(uint64_t)(BULK_COLUMN_ALIGN - 1);
+    return sizeof(BulkColumns) + column * columnSize;
+}
+
+// Sidecar header, followed by one bit per unit. The input's identity decides whether a
+// sidecar left behind belongs to this job
+typedef struct {
+    char magic[BULK_MAGIC_SIZE];
+    uint64_t inputSize;
+    uint64_t inputInode;
+    int64_t inputModified;  // Nanoseconds
+    uint64_t units;
+    uint32_t unitSize;
+    uint32_t format;
+} BulkCheckpoint;
+
+// Fill one fixed-width text slot with value, or with BULK_ERROR_TEXT if it isn't valid
+void bulkFormatRecord(char *slot, int isValid, int value);
+
+// Compute every line between begin and end into consecutive fixed-width slots, returns how many
+size_t bulkProcessText(const char *begin, const char *end, char *output);
+void bulkProcessBinary(const BulkRecord *records, size_t count, BulkResult *output);
+
+// Stream a text or CALCBIN1 input into output, returns the number of records. Either can be a
+// pipe, an input of unknown size passes BULK_SIZE_UNKNOWN
+#define BULK_SIZE_UNKNOWN SIZE_MAX
+size_t bulkStream(int input, size_t size, int output);
+
+// Buffers and ring of one process that streams ranges of a regular input file
+typedef struct BulkStream BulkStream;
+BulkStream *bulkStreamOpen(int input, int output);
+
+// Stream the text lines or binary records between byte offsets start and end of the input into
+// output from outputStart on. Returns the number of records once their results are written
+// back to the disk
+size_t bulkStreamRange(BulkStream *stream, size_t start, size_t end, size_t outputStart, int isBinary);
+
+// Compressed inputs are recognized by their magic and decompressed by gzip, zstd or lz4 in a
+// separate process, BULK_COMPRESS names the one that compresses the output. Both always stream,
+// in order and in one process, so a compressed job can't be split or resumed
+#define BULK_COMPRESS_ENV "BULK_COMPRESS"
+#define BULK_FILTER_PIPE (1 << 20)
+
+// Returns input itself if it isn't compressed, else the read end of a pipe from the filter
+int bulkDecompress(int input, pid_t *filter);
+
+// Returns the write end of a pipe into program, which writes the compressed data to output
+int bulkCompress(int output, const char *program, pid_t *filter);
+
+// Wait for a filter started above, exits if it failed. A filter of 0 is no filter
+void bulkFinishFilter(pid_t filter);
+
+#endif
@@ -0,0 +1,174 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bulk.h"
+#include "codec.h"
+
+// Converter for the columnar bulk format: ./bulk_convert <input> <output>
+// Text lines or CALCBIN1 records become a CALCCOL1 file, and CALCCOR1 or CALCRES1 results
+// become text with one value, or ERROR_FROM_EX2, per line
+
+static char *mapFile(const char *path, size_t size) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, size) < 0) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+    char *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+    return data;
+}
+
+// Create an empty columnar input file for count records and return its header
+static BulkColumns *createColumns(const char *path, size_t count, int32_t **column) {
+    BulkColumns *header = (BulkColumns *)mapFile(path, bulkColumnOffset(count, BULK_INPUT_COLUMNS));
+    memcpy(header->magic, BULK_COLUMNS_MAGIC, BULK_MAGIC_SIZE);
+    header->count = count;
+    for (int c = 0; c < BULK_INPUT_COLUMNS; c++) {
+        header->column[c] = bulkColumnOffset(count, c);
+        column[c] = (int32_t *)((char *)header + header->column[c]);
+    }
+    return header;
+}
+
+static size_t fromText(const char *input, size_t size, const char *path) {
+    size_t count = 0;
+    for (const char *next = input; (next = memchr(next, '\n', input + size - next)) != NULL; next++)
+        count++;
+    if (size > 0 && input[size - 1] != '\n')
+        count++;
+
+    int32_t *column[BULK_INPUT_COLUMNS];
+    createColumns(path, count, column);
+
+    // An unreadable line keeps operation 0, so the bulk tool reports it as invalid
+    const char *line = input, *end = input + size;
+    for (size_t i = 0; i < count; i++) {
+        const char *lineEnd = memchr(line, '\n', end - line);
+        if (lineEnd == NULL)
+            lineEnd = end;
+
+        int operand[4] = { 0, 0, 0, 0 };
+        if (codecParseInts(line, lineEnd, operand, 4) >= 3) {
+            for (int c = 0; c < BULK_INPUT_COLUMNS; c++)
+                column[c][i] = operand[c];
+        }
+        line = lineEnd + 1;
+    }
+    return count;
+}
+
+static size_t fromBinary(const char *input, size_t size, const char *path) {
+    if ((size - BULK_MAGIC_SIZE) % sizeof(BulkRecord) != 0) {
+        printf("ERROR_FROM_EX2 - truncated binary record\n");
+        exit(-1);
+    }
+    size_t count = (size - BULK_MAGIC_SIZE) / sizeof(BulkRecord);
+    const BulkRecord *records = (const BulkRecord *)(input + BULK_MAGIC_SIZE);
+
+    int32_t *column[BULK_INPUT_COLUMNS];
+    createColumns(path, count, column);
+    for (size_t i = 0; i < count; i++) {
+        column[BULK_COLUMN_NUM1][i] = records[i].num1;
+        column[BULK_COLUMN_OPERATION][i] = records[i].operation;
+        column[BULK_COLUMN_NUM2][i] = records[i].num2;
+        column[BULK_COLUMN_MODULUS][i] = records[i].modulus;
+    }
+    return count;
+}
+
+static void writeResult(FILE *output, int32_t result, int32_t status) {
+    char text[CODEC_INT_MAX_TEXT + 1];
+    if (status != 0) {
+        fputs(BULK_ERROR_TEXT "\n", output);
+        return;
+    }
+    codecFormatInt(result, text);
+    fputs(text, output);
+    fputc('\n', output);
+}
+
+static size_t toText(const char *input, size_t size, const char *path) {
+    FILE *output = fopen(path, "w");
+    if (output == NULL) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+
+    size_t count;
+    if (memcmp(input, BULK_RESULT_MAGIC, BULK_MAGIC_SIZE) == 0) {
+        count = (size - BULK_MAGIC_SIZE) / sizeof(BulkResult);
+        const BulkResult *results = (const BulkResult *)(input + BULK_MAGIC_SIZE);
+        for (size_t i = 0; i < count; i++)
+            writeResult(output, results[i].result, results[i].status);
+    } else {
+        const BulkColumns *header = (const BulkColumns *)input;
+        count = header->count;
+        for (int c = 0; c < BULK_RESULT_COLUMNS; c++) {
+            if (count > size / sizeof(int32_t) || header->column[c] > size - count * sizeof(int32_t)) {
+                printf("ERROR_FROM_EX2 - column outside the input file\n");
+                exit(-1);
+            }
+        }
+        const int32_t *result = (const int32_t *)(input + header->column[BULK_COLUMN_RESULT]);
+        const int32_t *status = (const int32_t *)(input + header->column[BULK_COLUMN_STATUS]);
+        for (size_t i = 0; i < count; i++)
+            writeResult(output, result[i], status[i]);
+    }
+
+    if (fclose(output) != 0) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        printf("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    struct stat fileStat;
+    if (fd < 0 || fstat(fd, &fileStat) < 0) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+
+    size_t size = fileStat.st_size;
+    const char *input = "";
+    if (size > 0) {
+        input = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (input == MAP_FAILED) {
+            perror("ERROR_FROM_EX2\n");
+            exit(-1);
+        }
+        madvise((void *)input, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    size_t count;
+    if (size >= BULK_MAGIC_SIZE && memcmp(input, BULK_BINARY_MAGIC, BULK_MAGIC_SIZE) == 0)
+        count = fromBinary(input, size, argv[2]);
+    else if ((size >= sizeof(BulkColumns) && memcmp(input, BULK_COLUMN_RESULT_MAGIC, BULK_MAGIC_SIZE) == 0) ||
+             (size >= BULK_MAGIC_SIZE && memcmp(input, BULK_RESULT_MAGIC, BULK_MAGIC_SIZE) == 0))
+        count = toText(input, size, argv[2]);
+    else
+        count = fromText(input, size, argv[2]);
+
+    printf("Bulk - Converted %zu records from '%s' into '%s'.\n", count, argv[1], argv[2]);
+    return 0;
+}
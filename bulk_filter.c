@@ -0,0 +1,110 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#define _GNU_SOURCE  // F_SETPIPE_SZ
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "bulk.h"
+
+// Compressed bulk files go through the system's gzip, zstd or lz4 running as a separate
+// process behind a pipe, so decompressing the next block overlaps computing this one and
+// nothing is ever unpacked to the disk first
+
+typedef struct {
+    const char *program;
+    unsigned char magic[4];
+    int magicSize;
+} BulkFilter;
+
+static const BulkFilter filters[] = {
+    { "gzip", { 0x1f, 0x8b }, 2 },
+    { "zstd", { 0x28, 0xb5, 0x2f, 0xfd }, 4 },
+    { "lz4", { 0x04, 0x22, 0x4d, 0x18 }, 4 },
+};
+#define FILTER_COUNT (int)(sizeof(filters) / sizeof(filters[0]))
+
+// Run program with option, reading from input and writing to output. otherEnd is the end of
+// the pipe that stays with us, the filter must not hold it open
+static pid_t spawnFilter(const char *program, const char *option, int input, int output, int otherEnd) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+    if (pid == 0) {
+        dup2(input, STDIN_FILENO);
+        dup2(output, STDOUT_FILENO);
+        if (input != STDIN_FILENO)
+            close(input);
+        if (output != STDOUT_FILENO)
+            close(output);
+        close(otherEnd);
+        execlp(program, program, option, (char *)NULL);
+
+        // Our stdout is the pipe by now
+        fprintf(stderr, "ERROR_FROM_EX2 - cannot run %s\n", program);
+        _exit(127);
+    }
+    return pid;
+}
+
+static void createPipe(int *ends) {
+    if (pipe(ends) < 0) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+    fcntl(ends[1], F_SETPIPE_SZ, BULK_FILTER_PIPE);
+}
+
+int bulkDecompress(int input, pid_t *filter) {
+    *filter = 0;
+    unsigned char magic[4];
+    ssize_t length = pread(input, magic, sizeof(magic), 0);
+
+    for (int f = 0; f < FILTER_COUNT; f++) {
+        if (length < filters[f].magicSize || memcmp(magic, filters[f].magic, filters[f].magicSize) != 0)
+            continue;
+
+        int ends[2];
+        createPipe(ends);
+        *filter = spawnFilter(filters[f].program, "-dc", input, ends[1], ends[0]);
+        close(ends[1]);
+        close(input);
+        return ends[0];
+    }
+    return input;
+}
+
+int bulkCompress(int output, const char *program, pid_t *filter) {
+    int f = 0;
+    while (f < FILTER_COUNT && strcmp(filters[f].program, program) != 0)
+        f++;
+    if (f == FILTER_COUNT) {
+        printf("ERROR_FROM_EX2 - unknown compression '%s'\n", program);
+        exit(-1);
+    }
+
+    // A compressor that dies makes our writes fail instead of killing us silently
+    signal(SIGPIPE, SIG_IGN);
+
+    int ends[2];
+    createPipe(ends);
+    *filter = spawnFilter(filters[f].program, "-c", ends[0], output, ends[1]);
+    close(ends[0]);
+    close(output);
+    return ends[1];
+}
+
+void bulkFinishFilter(pid_t filter) {
+    int status;
+    if (filter > 0 && (waitpid(filter, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+        printf("ERROR_FROM_EX2 - compression filter failed\n");
+        exit(-1);
+    }
+}
@@ -0,0 +1,348 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#define _GNU_SOURCE  // sync_file_range
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "bulk.h"
+#include "uring.h"
+
+// Streaming bulk mode for inputs that don't fit in memory. Block k is read into buffer k % 2
+// while the other buffer is computed, and each block's results are written from an output
+// buffer of the same parity while the next block is computed. With io_uring the reads and
+// writes run in the kernel meanwhile, without it they are plain pread/pwrite calls.
+// Consumed input and written output are dropped from the page cache as the stream moves on.
+// Either side can be a pipe to a compression filter, it is then read and written in order.
+// A regular input file can also be streamed one byte range at a time, each range into its own
+// place in the output, so several workers can split one job
+
+#define STREAM_INPUT_SLOT 0
+#define STREAM_OUTPUT_SLOT 1
+#define STREAM_READ(buffer) (buffer)
+#define STREAM_WRITE(buffer) (2 + (buffer))
+
+struct BulkStream {
+    Uring *ring;          // NULL to use pread/pwrite
+    int input, output;
+    int isInputPipe, isOutputPipe;
+    char *inBuffer[2];    // BULK_STREAM_CARRY bytes of room for a carried line, then the block
+    char *outBuffer[2];
+    int readResult[2];
+    int isPending[4];     // Indexed by STREAM_READ and STREAM_WRITE
+    uint64_t writeOffset[2];
+    unsigned writeLength[2];
+    uint64_t flushedOffset;  // Output before this is on the disk and out of the cache
+    uint64_t writtenEnd;     // End of the furthest write of the current range
+};
+
+static void streamFail(void) {
+    perror("ERROR_FROM_EX2\n");
+    exit(-1);
+}
+
+// Submit what is queued and handle completions until the one tagged tag has arrived
+static void streamWait(BulkStream *stream, int tag) {
+    while (stream->isPending[tag]) {
+        uint64_t userData;
+        int result;
+        if (!uringComplete(stream->ring, &userData, &result)) {
+            if (uringSubmit(stream->ring, 1) < 0)
+                streamFail();
+            continue;
+        }
+
+        stream->isPending[userData] = 0;
+        if (userData < STREAM_WRITE(0))
+            stream->readResult[userData] = result;
+        else if (result != (int)stream->writeLength[userData - STREAM_WRITE(0)]) {
+            errno = result < 0 ? -result : EIO;
+            streamFail();
+        }
+    }
+}
+
+static void startRead(BulkStream *stream, int buffer, uint64_t offset, unsigned length) {
+    char *data = stream->inBuffer[buffer] + BULK_STREAM_CARRY;
+    if (stream->isInputPipe) {
+        // A pipe hands out what the filter has written so far, fill the whole block
+        int filled = 0, result = 1;
+        while (filled < (int)length && (result = read(stream->input, data + filled, length - filled)) > 0)
+            filled += result;
+        stream->readResult[buffer] = result < 0 ? -1 : filled;
+        return;
+    }
+
+    // Without a ring, or without a free entry in it, the plain call does the same
+    struct io_uring_sqe *sqe = stream->ring != NULL ? uringEntry(stream->ring, STREAM_READ(buffer)) : NULL;
+    if (sqe == NULL) {
+        stream->readResult[buffer] = pread(stream->input, data, length, offset);
+        return;
+    }
+    uringPrepReadAt(sqe, STREAM_INPUT_SLOT, data, length, offset);
+    stream->isPending[STREAM_READ(buffer)] = 1;
+    if (uringSubmit(stream->ring, 0) < 0)
+        streamFail();
+}
+
+static int finishRead(BulkStream *stream, int buffer) {
+    if (stream->isPending[STREAM_READ(buffer)]) {
+        streamWait(stream, STREAM_READ(buffer));
+        if (stream->readResult[buffer] < 0) {
+            errno = -stream->readResult[buffer];
+            streamFail();
+        }
+    }
+    if (stream->readResult[buffer] < 0)
+        streamFail();
+    return stream->readResult[buffer];
+}
+
+static void writeAll(BulkStream *stream, const char *data, size_t length, uint64_t offset) {
+    while (length > 0) {
+        ssize_t written = stream->isOutputPipe ? write(stream->output, data, length)
+                                               : pwrite(stream->output, data, length, offset);
+        if (written <= 0)
+            streamFail();
+        data += written;
+        offset += written;
+        length -= written;
+    }
+}
+
+// Once a write is done its range is pushed to the disk, and the range before it, which had a
+// whole block's time to get there, is dropped from the cache
+static void finishWrite(BulkStream *stream, int buffer) {
+    streamWait(stream, STREAM_WRITE(buffer));
+    if (stream->writeLength[buffer] == 0 || stream->isOutputPipe)
+        return;
+
+    uint64_t offset = stream->writeOffset[buffer];
+    sync_file_range(stream->output, offset, stream->writeLength[buffer], SYNC_FILE_RANGE_WRITE);
+    if (offset > stream->flushedOffset) {
+        sync_file_range(stream->output, stream->flushedOffset, offset - stream->flushedOffset,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(stream->output, stream->flushedOffset, offset - stream->flushedOffset, POSIX_FADV_DONTNEED);
+        stream->flushedOffset = offset;
+    }
+    stream->writeLength[buffer] = 0;
+}
+
+static void startWrite(BulkStream *stream, int buffer, uint64_t offset, unsigned length) {
+    stream->writeOffset[buffer] = offset;
+    stream->writeLength[buffer] = length;
+    if (length == 0)
+        return;
+    if (offset + length > stream->writtenEnd)
+        stream->writtenEnd = offset + length;
+
+    struct io_uring_sqe *sqe = NULL;
+    if (stream->ring != NULL && !stream->isOutputPipe)
+        sqe = uringEntry(stream->ring, STREAM_WRITE(buffer));
+    if (sqe == NULL) {
+        writeAll(stream, stream->outBuffer[buffer], length, offset);
+        return;
+    }
+    uringPrepWriteAt(sqe, STREAM_OUTPUT_SLOT, stream->outBuffer[buffer], length, offset);
+    stream->isPending[STREAM_WRITE(buffer)] = 1;
+    if (uringSubmit(stream->ring, 0) < 0)
+        streamFail();
+}
+
+static void openStream(BulkStream *stream, int input, int output) {
+    memset(stream, 0, sizeof(*stream));
+    stream->input = input;
+    stream->output = output;
+
+    struct stat fileStat;
+    stream->isInputPipe = fstat(input, &fileStat) == 0 && S_ISFIFO(fileStat.st_mode);
+    stream->isOutputPipe = fstat(output, &fileStat) == 0 && S_ISFIFO(fileStat.st_mode);
+    if (!stream->isInputPipe)
+        posix_fadvise(input, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // Every text line becomes a 16-byte slot, even an empty one, so a block's results can be
+    // up to BULK_TEXT_WIDTH times its size. Binary results are half the size of their records
+    for (int b = 0; b < 2; b++) {
+        stream->inBuffer[b] = malloc(BULK_STREAM_CARRY + BULK_STREAM_BLOCK);
+        stream->outBuffer[b] = malloc((size_t)BULK_TEXT_WIDTH * (BULK_STREAM_CARRY + BULK_STREAM_BLOCK + 1));
+        if (stream->inBuffer[b] == NULL || stream->outBuffer[b] == NULL)
+            streamFail();
+    }
+
+    // Without io_uring the same steps run one after another. Pipes always go that way, and they
+    // stay out of the ring's file table, or the filter would never see the pipe close
+    if (stream->isInputPipe && stream->isOutputPipe)
+        return;
+    stream->ring = uringCreate(8, 2);
+    if (stream->ring != NULL && ((!stream->isInputPipe && uringSetFile(stream->ring, STREAM_INPUT_SLOT, input) < 0) ||
+                                 (!stream->isOutputPipe && uringSetFile(stream->ring, STREAM_OUTPUT_SLOT, output) < 0)))
+        stream->ring = NULL;
+}
+
+// Drop a consumed block of a file input from the cache
+static void releaseInput(BulkStream *stream, uint64_t offset, size_t length) {
+    if (!stream->isInputPipe)
+        posix_fadvise(stream->input, offset, length, POSIX_FADV_DONTNEED);
+}
+
+// Wait for the last writes and push the rest of the range to the disk, after this a checkpoint
+// may count the range as finished
+static void closeStream(BulkStream *stream) {
+    for (int b = 0; b < 2; b++)
+        finishWrite(stream, b);
+    if (stream->isOutputPipe || stream->writtenEnd <= stream->flushedOffset)
+        return;
+
+    uint64_t offset = stream->flushedOffset, length = stream->writtenEnd - offset;
+    sync_file_range(stream->output, offset, length,
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(stream->output, offset, length, POSIX_FADV_DONTNEED);
+    stream->flushedOffset = stream->writtenEnd;
+}
+
+// Read the block starting at offset, or note that there is none
+static void readBlock(BulkStream *stream, int buffer, uint64_t offset, size_t size) {
+    if (offset >= size) {
+        stream->readResult[buffer] = 0;
+        return;
+    }
+    startRead(stream, buffer, offset, size - offset < BULK_STREAM_BLOCK ? size - offset : BULK_STREAM_BLOCK);
+}
+
+// The lines between start and size, their results go from outputStart on
+static size_t streamText(BulkStream *stream, size_t start, size_t size, uint64_t outputStart) {
+    size_t count = 0, carry = 0;
+    int isSkipping = 0;  // Inside a line too long to carry, it was already reported invalid
+    uint64_t readOffset = start;
+
+    for (int b = 0;; b ^= 1) {
+        int length = finishRead(stream, b);
+        char *data = stream->inBuffer[b] + BULK_STREAM_CARRY;
+        char *begin = data - carry, *end = data + length;
+        if (length == 0) {
+            // The last line had no newline
+            if (carry > 0) {
+                finishWrite(stream, b);
+                count += bulkProcessText(begin, end, stream->outBuffer[b]);
+                startWrite(stream, b, outputStart + (count - 1) * BULK_TEXT_WIDTH, BULK_TEXT_WIDTH);
+            }
+            break;
+        }
+
+        if (isSkipping) {
+            char *newline = memchr(data, '\n', length);
+            isSkipping = newline == NULL;
+            begin = newline != NULL ? newline + 1 : end;
+        }
+
+        // Complete lines are computed now, the partial one at the end moves to the other buffer
+        char *lastLine = begin;
+        for (char *scan = end; scan > begin; scan--) {
+            if (scan[-1] == '\n') {
+                lastLine = scan;
+                break;
+            }
+        }
+
+        finishWrite(stream, b);
+        size_t lines = bulkProcessText(begin, lastLine, stream->outBuffer[b]);
+        carry = end - lastLine;
+        if (carry > BULK_STREAM_CARRY) {
+            // Far too long for a record, it becomes one invalid record and the rest is skipped
+            bulkFormatRecord(stream->outBuffer[b] + lines * BULK_TEXT_WIDTH, 0, 0);
+            lines++;
+            carry = 0;
+            isSkipping = 1;
+        } else {
+            memcpy(stream->inBuffer[b ^ 1] + BULK_STREAM_CARRY - carry, lastLine, carry);
+        }
+        startWrite(stream, b, outputStart + count * BULK_TEXT_WIDTH, lines * BULK_TEXT_WIDTH);
+        count += lines;
+
+        // This block is done with, its buffer takes the block after the next one
+        releaseInput(stream, readOffset, length);
+        readOffset += length;
+        readBlock(stream, b, readOffset + BULK_STREAM_BLOCK, size);
+    }
+    return count;
+}
+
+// The records between start and size after skipping skip bytes, their results go from
+// outputStart on
+static size_t streamBinary(BulkStream *stream, size_t start, size_t size, uint64_t outputStart, size_t skip) {
+    // Blocks needn't end on a record boundary, a partial record moves to the other buffer
+    size_t count = 0, carry = 0;
+    uint64_t readOffset = start;
+    for (int b = 0;; b ^= 1) {
+        int length = finishRead(stream, b);
+        if (length == 0)
+            break;
+
+        char *data = stream->inBuffer[b] + BULK_STREAM_CARRY;
+        char *begin = data - carry + skip, *end = data + length;
+        skip = 0;
+        size_t records = (end - begin) / sizeof(BulkRecord);
+        carry = (end - begin) % sizeof(BulkRecord);
+        memcpy(stream->inBuffer[b ^ 1] + BULK_STREAM_CARRY - carry, end - carry, carry);
+
+        finishWrite(stream, b);
+        bulkProcessBinary((const BulkRecord *)begin, records, (BulkResult *)stream->outBuffer[b]);
+        startWrite(stream, b, outputStart + count * sizeof(BulkResult), records * sizeof(BulkResult));
+        count += records;
+
+        releaseInput(stream, readOffset, length);
+        readOffset += length;
+        readBlock(stream, b, readOffset + BULK_STREAM_BLOCK, size);
+    }
+
+    if (carry != 0) {
+        printf("ERROR_FROM_EX2 - truncated binary record\n");
+        exit(-1);
+    }
+    return count;
+}
+
+size_t bulkStream(int input, size_t size, int output) {
+    BulkStream stream;
+    openStream(&stream, input, output);
+
+    // The first block tells the format, it is read again from the buffer by the loop
+    readBlock(&stream, 0, 0, size);
+    readBlock(&stream, 1, BULK_STREAM_BLOCK, size);
+    int length = finishRead(&stream, 0);
+    const char *magic = stream.inBuffer[0] + BULK_STREAM_CARRY;
+    if (length >= BULK_MAGIC_SIZE && memcmp(magic, BULK_COLUMNS_MAGIC, BULK_MAGIC_SIZE) == 0) {
+        printf("ERROR_FROM_EX2 - columnar input has to be mapped, it can't be compressed\n");
+        exit(-1);
+    }
+    int isBinary = length >= BULK_MAGIC_SIZE && memcmp(magic, BULK_BINARY_MAGIC, BULK_MAGIC_SIZE) == 0;
+    if (isBinary)
+        writeAll(&stream, BULK_RESULT_MAGIC, BULK_MAGIC_SIZE, 0);
+    size_t count = isBinary ? streamBinary(&stream, 0, size, BULK_MAGIC_SIZE, BULK_MAGIC_SIZE)
+                            : streamText(&stream, 0, size, 0);
+    closeStream(&stream);
+    return count;
+}
+
+BulkStream *bulkStreamOpen(int input, int output) {
+    BulkStream *stream = malloc(sizeof(BulkStream));
+    if (stream == NULL)
+        streamFail();
+    openStream(stream, input, output);
+    return stream;
+}
+
+size_t bulkStreamRange(BulkStream *stream, size_t start, size_t end, size_t outputStart, int isBinary) {
+    stream->flushedOffset = stream->writtenEnd = outputStart;
+    readBlock(stream, 0, start, end);
+    readBlock(stream, 1, start + BULK_STREAM_BLOCK, end);
+    size_t count = isBinary ? streamBinary(stream, start, end, outputStart, 0)
+                            : streamText(stream, start, end, outputStart);
+    closeStream(stream);
+    return count;
+}
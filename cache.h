@@ -0,0 +1,64 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "expr.h"
+
+// The cache lives in a mapped file so a restarted server starts warm. The path is absolute,
+// so clients started from any directory map the server's file
+#define CACHE_FILE_ENV "IPC_CACHE_FILE"
+#define CACHE_FILE_DEFAULT "/var/tmp/ipc_calc_cache.bin"
+#define CACHE_MAGIC 0x43414331u  // "CAC1"
+#define CACHE_FORMAT_VERSION 2   // Bump whenever the layout below changes
+#define CACHE_BUCKETS 4096
+#define CACHE_WAYS 8
+
+// One cached result. version is a sequence lock: odd while a writer owns the entry,
+// readers retry or skip when it changes under them. operation 0 marks an empty entry
+typedef struct {
+    atomic_uint version;
+    atomic_uint referenced;  // CLOCK bit, set on every hit
+    atomic_int num1, operation, num2, modulus;
+    atomic_int result;
+} CacheEntry;
+
+typedef struct {
+    atomic_uint hand;  // CLOCK hand over the ways of this bucket
+    CacheEntry ways[CACHE_WAYS];
+} CacheBucket;
+
+// Checked on every attach, a file written by a different build is discarded, never trusted
+typedef struct {
+    uint32_t magic;
+    uint32_t formatVersion;
+    uint64_t fileSize;
+    uint32_t buckets, ways;
+    uint32_t exprSlots, exprProgramSize;
+} CacheHeader;
+
+typedef struct {
+    CacheHeader header;
+    atomic_ulong hits, misses, inserts;
+    CacheBucket buckets[CACHE_BUCKETS];
+    ExprCache expressions;  // Compiled expressions, only touched by the server parent
+} ResultCache;
+
+// Map the cache file named by IPC_CACHE_FILE (default /var/tmp/ipc_calc_cache.bin). With
+// create set the file is created, or repaired or reset if its header doesn't match this
+// build, but only when no other server has it open. Returns NULL on failure, with errno
+// EINVAL for a relative path
+ResultCache *cacheOpen(int create);
+
+// Returns 1 and fills result on a hit, 0 on a miss
+int cacheLookup(ResultCache *cache, int num1, int operation, int num2, int modulus, int *result);
+
+// Insert a computed result, evicting with CLOCK inside the bucket. Gives up instead of waiting
+// if every way is busy, so neither side ever blocks on the other
+void cacheInsert(ResultCache *cache, int num1, int operation, int num2, int modulus, int result);
+
+#endif
@@ -0,0 +1,235 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#include <limits.h>
+
+#include "calc.h"
+
+// Number of independent operations advanced together in the batch kernels,
+// the lane loops below are written so the compiler can vectorize them
+#define BATCH_LANES 8
+
+static inline uint32_t montgomeryReduce(const MontgomeryContext *ctx, uint64_t t) {
+    uint32_t m = (uint32_t)t * ctx->inverse;
+    uint64_t reduced = (t + (uint64_t)m * ctx->modulus) >> 32;
+    return reduced >= ctx->modulus ? (uint32_t)(reduced - ctx->modulus) : (uint32_t)reduced;
+}
+
+static inline uint32_t toMontgomery(const MontgomeryContext *ctx, uint32_t a) {
+    return montgomeryReduce(ctx, (uint64_t)a * ctx->r2);
+}
+
+static uint32_t normalize(int a, int modulus) {
+    int r = a % modulus;
+    return (uint32_t)(r < 0 ? r + modulus : r);
+}
+
+int montgomeryInit(MontgomeryContext *ctx, uint32_t modulus) {
+    if (modulus < 3 || modulus > INT32_MAX || (modulus & 1) == 0)
+        return -1;
+
+    // Newton iteration doubles the number of correct low bits each round
+    uint32_t inv = modulus;
+    for (int i = 0; i < 4; i++)
+        inv *= 2 - modulus * inv;
+
+    uint64_t r = ((uint64_t)1 << 32) % modulus;
+    ctx->modulus = modulus;
+    ctx->inverse = -inv;
+    ctx->r2 = (uint32_t)((r * r) % modulus);
+    return 0;
+}
+
+uint32_t montgomeryMul(const MontgomeryContext *ctx, uint32_t a, uint32_t b) {
+    return montgomeryReduce(ctx, (uint64_t)a * b);
+}
+
+int mulMod(int a, int b, int modulus) {
+    return (int)(((uint64_t)normalize(a, modulus) * normalize(b, modulus)) % (uint32_t)modulus);
+}
+
+int powMod(int base, int exponent, int modulus) {
+    MontgomeryContext ctx;
+    uint32_t b = normalize(base, modulus);
+    uint32_t e = (uint32_t)exponent;
+
+    if (montgomeryInit(&ctx, (uint32_t)modulus) < 0) {
+        // Even (or tiny) modulus, plain square-and-multiply
+        uint64_t result = 1 % (uint32_t)modulus;
+        while (e > 0) {
+            if (e & 1)
+                result = (result * b) % (uint32_t)modulus;
+            b = (uint32_t)(((uint64_t)b * b) % (uint32_t)modulus);
+            e >>= 1;
+        }
+        return (int)result;
+    }
+
+    uint32_t result = toMontgomery(&ctx, 1);
+    b = toMontgomery(&ctx, b);
+    while (e > 0) {
+        if (e & 1)
+            result = montgomeryMul(&ctx, result, b);
+        b = montgomeryMul(&ctx, b, b);
+        e >>= 1;
+    }
+    return (int)montgomeryReduce(&ctx, result);
+}
+
+int mulModBatch(const int *a, const int *b, int *out, int count, int modulus) {
+    MontgomeryContext ctx;
+    int i;
+
+    if (modulus <= 0 || count < 0)
+        return -1;
+
+    if (montgomeryInit(&ctx, (uint32_t)modulus) < 0) {
+        for (i = 0; i < count; i++)
+            out[i] = mulMod(a[i], b[i], modulus);
+        return 0;
+    }
+
+    // REDC(REDC(a * R^2) * b) = a * b, two multiply-shift steps instead of a division
+    for (i = 0; i < count; i++) {
+        uint32_t x = toMontgomery(&ctx, normalize(a[i], modulus));
+        out[i] = (int)montgomeryMul(&ctx, x, normalize(b[i], modulus));
+    }
+    return 0;
+}
+
+int powModBatch(const int *base, const int *exponent, int *out, int count, int modulus) {
+    MontgomeryContext ctx;
+    int i, lane;
+
+    if (modulus <= 0 || count < 0)
+        return -1;
+    for (i = 0; i < count; i++) {
+        if (exponent[i] < 0)
+            return -1;
+    }
+
+    if (montgomeryInit(&ctx, (uint32_t)modulus) < 0) {
+        for (i = 0; i < count; i++)
+            out[i] = powMod(base[i], exponent[i], modulus);
+        return 0;
+    }
+
+    uint32_t one = toMontgomery(&ctx, 1);
+    for (i = 0; i < count; i += BATCH_LANES) {
+        uint32_t result[BATCH_LANES], b[BATCH_LANES], e[BATCH_LANES];
+        uint32_t pending = 0;
+
+        // Load the lanes, unused tail lanes get exponent 0 and stay at one
+        for (lane = 0; lane < BATCH_LANES; lane++) {
+            int inRange = i + lane < count;
+            result[lane] = one;
+            b[lane] = inRange ? toMontgomery(&ctx, normalize(base[i + lane], modulus)) : one;
+            e[lane] = inRange ? (uint32_t)exponent[i + lane] : 0;
+            pending |= e[lane];
+        }
+
+        // Advance all lanes one exponent bit at a time, selecting instead of branching
+        while (pending) {
+            pending = 0;
+            for (lane = 0; lane < BATCH_LANES; lane++) {
+                uint32_t product = montgomeryMul(&ctx, result[lane], b[lane]);
+                result[lane] = (e[lane] & 1) ? product : result[lane];
+                b[lane] = montgomeryMul(&ctx, b[lane], b[lane]);
+                e[lane] >>= 1;
+                pending |= e[lane];
+            }
+        }
+
+        for (lane = 0; lane < BATCH_LANES && i + lane < count; lane++)
+            out[i + lane] = (int)montgomeryReduce(&ctx, result[lane]);
+    }
+    return 0;
+}
+
+// INT_MIN / -1 overflows and traps like a zero divisor, both are invalid requests
+static int isDivisible(int num1, int num2) {
+    return num2 != 0 && !(num1 == INT_MIN && num2 == -1);
+}
+
+int checkOperation(int num1, int operation, int num2, int modulus) {
+    switch (operation) {
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+            return 0;
+        case OP_DIV:
+            return isDivisible(num1, num2) ? 0 : -1;
+        case OP_MULMOD:
+            return modulus > 0 ? 0 : -1;
+        case OP_POWMOD:
+            return modulus > 0 && num2 >= 0 ? 0 : -1;
+        default:
+            return -1;
+    }
+}
+
+int computeOperation(int num1, int operation, int num2, int modulus, int *result) {
+    switch (operation) {
+        case OP_ADD: // Addition
+            *result = num1 + num2;
+            break;
+        case OP_SUB: // Subtraction
+            *result = num1 - num2;
+            break;
+        case OP_MUL: // Multiplication
+            *result = num1 * num2;
+            break;
+        case OP_DIV: // Division
+            if (!isDivisible(num1, num2))
+                return -1;
+            *result = num1 / num2;
+            break;
+        case OP_MULMOD: // Modular multiplication
+            if (modulus <= 0)
+                return -1;
+            *result = mulMod(num1, num2, modulus);
+            break;
+        case OP_POWMOD: // Modular exponentiation
+            if (modulus <= 0 || num2 < 0)
+                return -1;
+            *result = powMod(num1, num2, modulus);
+            break;
+        default:
+            return -1;
+    }
+    return 0;
+}
+
+int computeBatch(const int *num1, int operation, const int *num2, int modulus, int *out, int count) {
+    int i;
+
+    // Plain loops per operation, so each one vectorizes on its own
+    switch (operation) {
+        case OP_ADD:
+            for (i = 0; i < count; i++)
+                out[i] = num1[i] + num2[i];
+            return 0;
+        case OP_SUB:
+            for (i = 0; i < count; i++)
+                out[i] = num1[i] - num2[i];
+            return 0;
+        case OP_MUL:
+            for (i = 0; i < count; i++)
+                out[i] = num1[i] * num2[i];
+            return 0;
+        case OP_DIV:
+            for (i = 0; i < count; i++) {
+                if (!isDivisible(num1[i], num2[i]))
+                    return -1;
+            }
+            for (i = 0; i < count; i++)
+                out[i] = num1[i] / num2[i];
+            return 0;
+        case OP_MULMOD:
+            return mulModBatch(num1, num2, out, count, modulus);
+        case OP_POWMOD:
+            return powModBatch(num1, num2, out, count, modulus);
+        default:
+            return -1;
+    }
+}
@@ -0,0 +1,45 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#ifndef CALC_H
+#define CALC_H
+
+#include <stdint.h>
+
+// Operation codes understood by the server
+#define OP_ADD 1
+#define OP_SUB 2
+#define OP_MUL 3
+#define OP_DIV 4
+#define OP_MULMOD 5  // (num1 * num2) mod modulus
+#define OP_POWMOD 6  // num1 ^ num2 mod modulus
+
+// Montgomery form for an odd modulus below 2^31, with R = 2^32
+typedef struct {
+    uint32_t modulus;
+    uint32_t inverse;  // -modulus^-1 mod 2^32
+    uint32_t r2;       // R^2 mod modulus, used to enter Montgomery form
+} MontgomeryContext;
+
+// Returns 0 on success, -1 if the modulus is not odd or out of range
+int montgomeryInit(MontgomeryContext *ctx, uint32_t modulus);
+uint32_t montgomeryMul(const MontgomeryContext *ctx, uint32_t a, uint32_t b);
+
+// Single modular operations, operands may be negative, modulus must be positive
+int mulMod(int a, int b, int modulus);
+int powMod(int base, int exponent, int modulus);
+
+// Batches of independent operations sharing one modulus, returns -1 on invalid input
+int mulModBatch(const int *a, const int *b, int *out, int count, int modulus);
+int powModBatch(const int *base, const int *exponent, int *out, int count, int modulus);
+
+// Returns 0 if computeOperation would accept the operation with these operands, else -1
+int checkOperation(int num1, int operation, int num2, int modulus);
+
+// Perform one operation, returns 0 on success and -1 on an invalid request
+int computeOperation(int num1, int operation, int num2, int modulus, int *result);
+
+// Apply one operation to count operand pairs, returns -1 if any pair is invalid
+int computeBatch(const int *num1, int operation, const int *num2, int modulus, int *out, int count);
+
+#endif
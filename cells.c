@@ -0,0 +1,209 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "calc.h"
+#include "cells.h"
+
+int cellFind(const CellGraph *graph, const char *name) {
+    for (int i = 0; i < graph->count; i++) {
+        if (strcmp(graph->cells[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static int addCell(CellGraph *graph, const char *name) {
+    if (graph->count >= CELL_MAX || strlen(name) >= CELL_MAX_NAME)
+        return -1;
+
+    Cell *cell = &graph->cells[graph->count];
+    memset(cell, 0, sizeof(*cell));
+    strcpy(cell->name, name);
+    cell->isValid = 1;
+    graph->order[graph->count] = graph->count;
+    return graph->count++;
+}
+
+// Rank of a cell above its inputs, state is 0 unvisited, 1 on the current path, 2 done
+static int rankCell(CellGraph *graph, int c, char *state) {
+    Cell *cell = &graph->cells[c];
+    if (state[c] == 2)
+        return cell->rank;
+    if (state[c] == 1)
+        return -1;
+
+    state[c] = 1;
+    cell->rank = 0;
+    for (int i = 0; i < CELL_OPERANDS; i++) {
+        if (!cell->reference[i])
+            continue;
+        int dependency = rankCell(graph, cell->value[i], state);
+        if (dependency < 0)
+            return -1;
+        if (dependency + 1 > cell->rank)
+            cell->rank = dependency + 1;
+    }
+    state[c] = 2;
+    return cell->rank;
+}
+
+static int rankCells(CellGraph *graph) {
+    char state[CELL_MAX] = { 0 };
+    for (int c = 0; c < graph->count; c++) {
+        if (rankCell(graph, c, state) < 0)
+            return -1;
+    }
+
+    // Insertion sort, the order is nearly sorted already after a single definition
+    for (int i = 1; i < graph->count; i++) {
+        int c = graph->order[i];
+        int j = i - 1;
+        while (j >= 0 && graph->cells[graph->order[j]].rank > graph->cells[c].rank) {
+            graph->order[j + 1] = graph->order[j];
+            j--;
+        }
+        graph->order[j + 1] = c;
+    }
+    return 0;
+}
+
+static void evaluateCell(CellGraph *graph, Cell *cell) {
+    int operand[CELL_OPERANDS];
+
+    cell->isValid = 1;
+    for (int i = 0; i < CELL_OPERANDS; i++) {
+        if (!cell->reference[i]) {
+            operand[i] = cell->value[i];
+            continue;
+        }
+        const Cell *input = &graph->cells[cell->value[i]];
+        operand[i] = input->result;
+        if (!input->isValid)
+            cell->isValid = 0;
+    }
+
+    if (cell->isValid && computeOperation(operand[0], cell->operation, operand[1], operand[2], &cell->result) < 0)
+        cell->isValid = 0;
+}
+
+// Recompute only the formulas downstream of source, walking in rank order and
+// stopping at cells whose value came out unchanged
+static int propagate(CellGraph *graph, int source, int *changed) {
+    char dirty[CELL_MAX] = { 0 };
+    int count = 0;
+
+    dirty[source] = 1;
+    changed[count++] = source;
+
+    for (int i = 0; i < graph->count; i++) {
+        int c = graph->order[i];
+        Cell *cell = &graph->cells[c];
+        if (c == source || !cell->isFormula)
+            continue;
+
+        int isAffected = 0;
+        for (int j = 0; j < CELL_OPERANDS; j++) {
+            if (cell->reference[j] && dirty[cell->value[j]])
+                isAffected = 1;
+        }
+        if (!isAffected)
+            continue;
+
+        int oldResult = cell->result, oldValid = cell->isValid;
+        evaluateCell(graph, cell);
+        if (cell->result != oldResult || cell->isValid != oldValid) {
+            dirty[c] = 1;
+            changed[count++] = c;
+        }
+    }
+    return count;
+}
+
+int cellSet(CellGraph *graph, const char *name, int value, int *changed) {
+    int c = cellFind(graph, name);
+    if (c < 0) {
+        c = addCell(graph, name);
+        if (c < 0)
+            return -1;
+    } else if (graph->cells[c].isFormula) {
+        return -1;
+    } else if (graph->cells[c].result == value) {
+        return 0;
+    }
+
+    graph->cells[c].result = value;
+    return propagate(graph, c, changed);
+}
+
+int cellDefine(CellGraph *graph, const char *name, char *operands[CELL_OPERANDS], int operation, int *changed) {
+    int c = cellFind(graph, name);
+    int isNew = c < 0;
+    if (isNew) {
+        c = addCell(graph, name);
+        if (c < 0)
+            return -1;
+    }
+
+    Cell *cell = &graph->cells[c];
+    Cell previous = *cell;
+    cell->isFormula = 1;
+    cell->operation = operation;
+
+    for (int i = 0; i < CELL_OPERANDS; i++) {
+        const char *operand = operands[i];
+        cell->reference[i] = operand != NULL && !isdigit((unsigned char)operand[0]) && operand[0] != '-';
+        if (!cell->reference[i]) {
+            cell->value[i] = operand != NULL ? atoi(operand) : 0;
+            continue;
+        }
+        cell->value[i] = cellFind(graph, operand);
+        if (cell->value[i] < 0)
+            goto rollback;
+    }
+
+    if (rankCells(graph) < 0)
+        goto rollback;
+
+    evaluateCell(graph, cell);
+    return propagate(graph, c, changed);
+
+rollback:
+    if (isNew)
+        graph->count--;
+    else
+        *cell = previous;
+    for (int i = 0; i < graph->count; i++)
+        graph->order[i] = i;
+    rankCells(graph);
+    return -1;
+}
+
+int cellSubscribe(CellGraph *graph, const char *name, int pid) {
+    int c = cellFind(graph, name);
+    if (c < 0)
+        return -1;
+
+    Cell *cell = &graph->cells[c];
+    for (int i = 0; i < cell->subscriberCount; i++) {
+        if (cell->subscribers[i] == pid)
+            return c;
+    }
+    if (cell->subscriberCount >= CELL_MAX_SUBSCRIBERS)
+        return -1;
+    cell->subscribers[cell->subscriberCount++] = pid;
+    return c;
+}
+
+void cellUnsubscribe(CellGraph *graph, int index, int pid) {
+    Cell *cell = &graph->cells[index];
+    for (int i = 0; i < cell->subscriberCount; i++) {
+        if (cell->subscribers[i] == pid) {
+            cell->subscribers[i] = cell->subscribers[--cell->subscriberCount];
+            return;
+        }
+    }
+}
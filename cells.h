@@ -0,0 +1,48 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#ifndef CELLS_H
+#define CELLS_H
+
+#define CELL_MAX 256
+#define CELL_MAX_NAME 16
+#define CELL_MAX_SUBSCRIBERS 8
+
+// Operand slots of a formula: num1, num2 and the modulus of the modular operations
+#define CELL_OPERANDS 3
+
+typedef struct {
+    char name[CELL_MAX_NAME];
+    int isFormula;
+    int operation;
+    int value[CELL_OPERANDS];      // Literal value, or the index of the referenced cell
+    int reference[CELL_OPERANDS];  // 1 if value is a cell index
+    int result;
+    int isValid;                   // 0 if the formula failed, for example divided by zero
+    int rank;                      // Inputs are 0, formulas sit above everything they read
+    int subscribers[CELL_MAX_SUBSCRIBERS];
+    int subscriberCount;
+} Cell;
+
+typedef struct {
+    int count;
+    int order[CELL_MAX];  // Cell indexes sorted by rank, a valid recomputation order
+    Cell cells[CELL_MAX];
+} CellGraph;
+
+int cellFind(const CellGraph *graph, const char *name);
+
+// Set an input cell, creating it if needed. Formula cells can't be set.
+// Cells whose value changed, starting with the input itself, are stored in changed.
+// Returns the number of changed cells or -1
+int cellSet(CellGraph *graph, const char *name, int value, int *changed);
+
+// Define name as "a op b [modulus]" where each operand is a number or a cell name.
+// Returns the number of changed cells like cellSet, or -1 on an unknown cell or a cycle
+int cellDefine(CellGraph *graph, const char *name, char *operands[CELL_OPERANDS], int operation, int *changed);
+
+// Register pid for pushes when the cell changes, returns -1 if the cell or the list is missing or full
+int cellSubscribe(CellGraph *graph, const char *name, int pid);
+void cellUnsubscribe(CellGraph *graph, int index, int pid);
+
+#endif
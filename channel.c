@@ -0,0 +1,190 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "channel.h"
+
+#define REQUIRED_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+
+void channelPath(int serverPID, char *path) {
+    snprintf(path, CHANNEL_PATH_MAX, CHANNEL_PATH_FORMAT, serverPID);
+}
+
+static void socketAddress(int serverPID, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    channelPath(serverPID, address->sun_path);
+}
+
+int channelListen(void) {
+    struct sockaddr_un address;
+    socketAddress(getpid(), &address);
+    unlink(address.sun_path);  // Left over from an earlier server with the same PID
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -1;
+    if (bind(sock, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(sock, 64) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int channelConnect(int serverPID) {
+    struct sockaddr_un address;
+    socketAddress(serverPID, &address);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -1;
+    if (connect(sock, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int channelSend(int sock, const ChannelMessage *message, const int *fds, int fdCount) {
+    struct iovec iov = { (void *)message, sizeof(*message) };
+    union {
+        char buffer[CMSG_SPACE(CHANNEL_MAX_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr header;
+    memset(&header, 0, sizeof(header));
+    header.msg_iov = &iov;
+    header.msg_iovlen = 1;
+
+    // Descriptors travel as SCM_RIGHTS ancillary data, the kernel installs copies in the receiver
+    if (fdCount > 0) {
+        memset(&control, 0, sizeof(control));
+        header.msg_control = control.buffer;
+        header.msg_controllen = CMSG_SPACE(fdCount * sizeof(int));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&header);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(fdCount * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, fdCount * sizeof(int));
+    }
+
+    return sendmsg(sock, &header, MSG_NOSIGNAL) == (ssize_t)sizeof(*message) ? 0 : -1;
+}
+
+int channelReceive(int sock, ChannelMessage *message, int *fds) {
+    struct iovec iov = { message, sizeof(*message) };
+    union {
+        char buffer[CMSG_SPACE(CHANNEL_MAX_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr header;
+    memset(&header, 0, sizeof(header));
+    header.msg_iov = &iov;
+    header.msg_iovlen = 1;
+    header.msg_control = control.buffer;
+    header.msg_controllen = sizeof(control.buffer);
+
+    ssize_t received = recvmsg(sock, &header, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    if (received != (ssize_t)sizeof(*message))
+        return -1;
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&header);
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+        return 0;
+    int fdCount = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    memcpy(fds, CMSG_DATA(cmsg), fdCount * sizeof(int));
+    return fdCount;
+}
+
+int channelSendData(int sock, const void *data, size_t size) {
+    const char *next = data;
+    while (size > 0) {
+        ssize_t sent = send(sock, next, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return -1;
+        next += sent;
+        size -= sent;
+    }
+    return 0;
+}
+
+int channelReceiveData(int sock, void *data, size_t size) {
+    char *next = data;
+    while (size > 0) {
+        ssize_t received = recv(sock, next, size, MSG_WAITALL);
+        if (received <= 0)
+            return -1;
+        next += received;
+        size -= received;
+    }
+    return 0;
+}
+
+int channelCreatePayload(const char *name, size_t size, void **data) {
+    int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        return -1;
+
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    *data = size > 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : NULL;
+    if (*data == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int channelSealPayload(int fd, void *data, size_t size) {
+    // F_SEAL_WRITE fails while a writable shared mapping exists
+    if (data != NULL)
+        munmap(data, size);
+    return fcntl(fd, F_ADD_SEALS, REQUIRED_SEALS | F_SEAL_SEAL);
+}
+
+const void *channelMapPayload(int fd, size_t size) {
+    // Without the seals the sender could truncate the file under us (SIGBUS) or change it mid-computation
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || (seals & REQUIRED_SEALS) != REQUIRED_SEALS)
+        return NULL;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) < 0 || (size_t)fileStat.st_size < size)
+        return NULL;
+    if (size == 0)
+        return "";
+
+    const void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    return data == MAP_FAILED ? NULL : data;
+}
+
+int channelSealDestination(int fd) {
+    return fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+}
+
+void *channelMapDestination(int fd, size_t size) {
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || (seals & F_SEAL_SHRINK) == 0 || (seals & F_SEAL_WRITE) != 0)
+        return NULL;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) < 0 || (size_t)fileStat.st_size < size)
+        return NULL;
+    if (size == 0)
+        return (void *)"";
+
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return data == MAP_FAILED ? NULL : data;
+}
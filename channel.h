@@ -0,0 +1,66 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <stdint.h>
+
+// Unix socket next to the signal protocol, for requests whose payload is passed as a file descriptor
+#define CHANNEL_PATH_FORMAT "/tmp/ipc_calc_%d.sock"
+#define CHANNEL_PATH_MAX 108
+
+// Message kinds
+#define CHANNEL_VECTOR 1  // Operands in a sealed memfd: count num1 values, then count num2 values
+#define CHANNEL_RESULT 2  // Results in a sealed memfd: count values, or no memfd after CHANNEL_VECTOR_INTO
+#define CHANNEL_VECTOR_INTO 3  // Like CHANNEL_VECTOR plus a second memfd the results are written into
+#define CHANNEL_STREAM 4  // Like CHANNEL_VECTOR, results come back as chunks paced by credits
+#define CHANNEL_CHUNK 5   // count result values, sent inline right after the message
+#define CHANNEL_CREDIT 6  // The receiver can take count more chunks
+
+// Values per streamed chunk, and the chunks a stream client lets the server run ahead
+#define CHANNEL_CHUNK_VALUES 4096
+#define CHANNEL_STREAM_WINDOW 4
+
+#define CHANNEL_MAX_FDS 2
+
+typedef struct {
+    uint32_t kind;
+    int32_t operation;
+    int32_t modulus;
+    uint32_t count;
+    int32_t status;  // 0 or -1 in a result
+} ChannelMessage;
+
+void channelPath(int serverPID, char *path);
+
+// Listening socket for this process, returns -1 on failure
+int channelListen(void);
+int channelConnect(int serverPID);
+
+// Send one message with up to CHANNEL_MAX_FDS file descriptors, returns -1 on failure
+int channelSend(int sock, const ChannelMessage *message, const int *fds, int fdCount);
+
+// Receive one message, returns the number of descriptors stored in fds or -1 on failure
+int channelReceive(int sock, ChannelMessage *message, int *fds);
+
+// Send or receive size bytes of inline data after a message, returns -1 on failure
+int channelSendData(int sock, const void *data, size_t size);
+int channelReceiveData(int sock, void *data, size_t size);
+
+// Create a memfd of size bytes, mapped writable into *data. Returns the fd or -1
+int channelCreatePayload(const char *name, size_t size, void **data);
+
+// Unmap the payload and seal it against writes and resizing before it is passed on
+int channelSealPayload(int fd, void *data, size_t size);
+
+// Map a received payload read-only, after checking it is sealed and at least size bytes
+const void *channelMapPayload(int fd, size_t size);
+
+// Seal a destination buffer against resizing only, so the receiver can map and fill it
+int channelSealDestination(int fd);
+
+// Map a received destination writable, after checking it can't shrink and holds size bytes
+void *channelMapDestination(int fd, size_t size);
+
+#endif
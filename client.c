@@ -8,23 +8,70 @@
 #include <unistd.h>
 #include <signal.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/random.h>
 
+#include "arena.h"
+#include "cache.h"
+#include "channel.h"
+#include "codec.h"
+#include "registry.h"
+#include "spool.h"
+
 #define MAX_RETRIES 10
 #define RESPONSE_TIMEOUT_SECONDS 30
+#define REQUEST_MAX 4096
+
+char responseFile[SPOOL_PATH_MAX];  // Declare responseFile globally
+int serverPID;  // The PID given as argv[1], or the instance the registry routed us to
+char request[REQUEST_MAX];
+int isWatching = 0;  // Watchers stay alive and keep receiving pushed cell updates
+int isCalculation = 0;  // Plain "num1 op num2 [modulus]" request, the only kind that is cached
 
-char responseFile[64];  // Declare responseFile globally
+// Server arena holding the operands of a shared-memory request, the response names the results block
+Arena *sharedArena;
+uint32_t operandOffset;
+uint32_t resultOffset;  // Block the server writes the results into
+int sharedCount;
 
 void intToStr(int num, char *str); // Function prototype for intToStr
 
+void printSharedResults(const char *response) {
+    // The response is just the offset of the results block, the one allocated by buildRequest
+    if ((uint32_t)strtoul(response, NULL, 10) != resultOffset) {
+        printf("ERROR_FROM_EX2\n");
+        exit(0);
+    }
+    const int *results = arenaPointer(sharedArena, resultOffset, (size_t)sharedCount * sizeof(int));
+    if (results == NULL) {
+        printf("ERROR_FROM_EX2\n");
+        exit(0);
+    }
+
+    printf("Client - Received %d results from server arena. end of stage j.\n", sharedCount);
+    for (int i = 0; i < sharedCount; i++)
+        printf("%d\n", results[i]);
+    arenaFree(sharedArena, resultOffset);
+    arenaFree(sharedArena, operandOffset);
+}
+
 void signalHandler(int signal) {
     // Read the response file
     int myPID = getpid();
-    intToStr(myPID, responseFile);
-    strcat(responseFile, "_toClient.txt");
+    spoolResponsePath(myPID, responseFile);
+
+    // Watchers take the file before reading it, so an update pushed meanwhile starts a new
+    // file instead of being deleted unread. Signals coalesce, so the file may already be taken
+    char readFile[SPOOL_PATH_MAX + 8];
+    strcpy(readFile, responseFile);
+    if (isWatching) {
+        strcat(readFile, ".taken");
+        if (rename(responseFile, readFile) != 0)
+            return;
+    }
 
     // Wait until the response file is created by the server
-    while (access(responseFile, F_OK) == -1) {
+    while (access(readFile, F_OK) == -1) {
         usleep(10000); // Sleep for 10 milliseconds
     }
 
@@ -32,15 +79,24 @@ void signalHandler(int signal) {
     alarm(0);
 
     // Open the response file for reading
-    int responseFD = open(responseFile, O_RDONLY);
+    int responseFD = open(readFile, O_RDONLY);
     if (responseFD < 0) {
         perror("ERROR_FROM_EX2");
         exit(0);
     }
 
-    // Read the result from the response file
-    char responseBuffer[256];
-    ssize_t bytesRead = read(responseFD, responseBuffer, sizeof(responseBuffer) - 1);
+    // Read the result from the response file, batch results can be long
+    struct stat fileStat;
+    if (fstat(responseFD, &fileStat) < 0) {
+        perror("ERROR_FROM_EX2");
+        exit(0);
+    }
+    char *responseBuffer = malloc(fileStat.st_size + 1);
+    if (responseBuffer == NULL) {
+        perror("ERROR_FROM_EX2");
+        exit(0);
+    }
+    ssize_t bytesRead = read(responseFD, responseBuffer, fileStat.st_size);
     if (bytesRead < 0) {
         perror("ERROR_FROM_EX2");
         exit(0);
@@ -48,16 +104,23 @@ void signalHandler(int signal) {
     responseBuffer[bytesRead] = '\0';
 
     // Print the received result
-    printf("Client - Received result from server: %s. end of stage j.\n", responseBuffer);
+    if (sharedArena != NULL)
+        printSharedResults(responseBuffer);
+    else
+        printf("Client - Received result from server: %s. end of stage j.\n", responseBuffer);
+    fflush(stdout);
 
     // Close the response file
     close(responseFD);
+    free(responseBuffer);
 
     // Delete the response file
-    if (remove(responseFile) != 0) {
+    if (remove(readFile) != 0) {
         perror("ERROR_FROM_EX2");
     }
 
+    if (isWatching)
+        return;
     exit(0); // Add this line to exit the client program after receiving the result and deleting the file
 }
 
@@ -67,35 +130,304 @@ void timerHandler(int signal) {
 }
 
 void intToStr(int num, char *str) {
-    int i = 0, j = 0;
-    char temp[10];
+    codecFormatInt(num, str);
+}
 
-    if (num == 0) {
-        str[0] = '0';
-        str[1] = '\0';
-        return;
+// "-" instead of a PID lets the registry pick the instance. Session registers and cells live
+// in one instance, so those requests go to the instance that holds the session (all cells share
+// one key). Anything else may go anywhere and goes to the less loaded of two random instances
+int resolveServer(int argc, char *argv[]) {
+    if (strcmp(argv[1], "-") != 0)
+        return atoi(argv[1]);
+
+    static RegistryRing ring;
+    ring.registry = registryOpen();
+    if (ring.registry == NULL)
+        return -1;
+
+    if (strcmp(argv[2], "acc") == 0 && argc > 3)
+        return registryRouteState(&ring, REGISTRY_SESSION, atoi(argv[3]));
+    if (strcmp(argv[2], "cell") == 0)
+        return registryRouteState(&ring, REGISTRY_CELLS, 0);
+    return registryChoose(ring.registry);
+}
+
+int readOperandPairs(int **num1, int **num2) {
+    // All of stdin at once, then one "num1 num2" pair per line until the first line that isn't one
+    size_t size = 0, capacity = 1 << 16;
+    char *text = malloc(capacity);
+    ssize_t bytesRead;
+    while (text != NULL && (bytesRead = read(STDIN_FILENO, text + size, capacity - size)) > 0) {
+        size += bytesRead;
+        if (size == capacity) {
+            capacity *= 2;
+            text = realloc(text, capacity);
+        }
+    }
+
+    int count = 0, pairCapacity = 1024;
+    *num1 = malloc(pairCapacity * sizeof(int));
+    *num2 = malloc(pairCapacity * sizeof(int));
+    if (text == NULL || *num1 == NULL || *num2 == NULL)
+        return -1;
+
+    const char *line = text, *end = text + size;
+    while (line < end) {
+        const char *lineEnd = memchr(line, '\n', end - line);
+        if (lineEnd == NULL)
+            lineEnd = end;
+
+        int pair[2];
+        int fields = codecParseInts(line, lineEnd, pair, 2);
+        if (fields != 0 && fields != 2)
+            break;
+        if (fields == 2) {
+            (*num1)[count] = pair[0];
+            (*num2)[count] = pair[1];
+            if (++count == pairCapacity) {
+                pairCapacity *= 2;
+                *num1 = realloc(*num1, pairCapacity * sizeof(int));
+                *num2 = realloc(*num2, pairCapacity * sizeof(int));
+                if (*num1 == NULL || *num2 == NULL)
+                    return -1;
+            }
+        }
+        line = lineEnd + 1;
+    }
+    free(text);
+    return count;
+}
+
+int buildRequest(int argc, char *argv[]) {
+    int myPID = getpid();
+    intToStr(myPID, request);
+
+    // Expression requests: the expression on the first line, one binding row per line after it
+    if (strcmp(argv[2], "expr") == 0) {
+        if (argc < 4)
+            return -1;
+        size_t length = strlen(request) + strlen(" expr ") + strlen(argv[3]) + 1;
+        for (int i = 4; i < argc; i++)
+            length += strlen(argv[i]) + 1;
+        if (length >= REQUEST_MAX)
+            return -1;
+
+        strcat(request, " expr ");
+        strcat(request, argv[3]);
+        for (int i = 4; i < argc; i++) {
+            strcat(request, "\n");
+            strcat(request, argv[i]);
+        }
+        return 0;
     }
 
-    while (num > 0) {
-        temp[i++] = (num % 10) + '0';
-        num /= 10;
+    // Shared-memory batches: operands are placed in the server's arena, the request carries offsets
+    if (strcmp(argv[2], "shm") == 0) {
+        if (argc != 4 && argc != 5)
+            return -1;
+        int *num1, *num2;
+        sharedCount = readOperandPairs(&num1, &num2);
+        sharedArena = arenaAttach(serverPID);
+        if (sharedCount < 0 || sharedArena == NULL)
+            return -1;
+
+        operandOffset = arenaAlloc(sharedArena, 2 * (size_t)sharedCount * sizeof(int));
+        int *operands = arenaPointer(sharedArena, operandOffset, 2 * (size_t)sharedCount * sizeof(int));
+        if (operands == NULL)
+            return -1;
+        memcpy(operands, num1, sharedCount * sizeof(int));
+        memcpy(operands + sharedCount, num2, sharedCount * sizeof(int));
+        free(num1);
+        free(num2);
+
+        // The results block is ours too, the server fills it in place instead of allocating one
+        resultOffset = arenaAlloc(sharedArena, (size_t)sharedCount * sizeof(int));
+        if (resultOffset == 0)
+            return -1;
+
+        snprintf(request + strlen(request), REQUEST_MAX - strlen(request), " shm %s %s %d %u %u",
+                 argv[3], argc == 5 ? argv[4] : "0", sharedCount, operandOffset, resultOffset);
+        return 0;
     }
 
-    temp[i] = '\0';
+    // Operation chains: one node per argument, operands may name earlier results as rK
+    if (strcmp(argv[2], "dag") == 0) {
+        if (argc < 4)
+            return -1;
+        size_t length = strlen(request) + strlen(" dag") + 1;
+        for (int i = 3; i < argc; i++)
+            length += strlen(argv[i]) + 1;
+        if (length >= REQUEST_MAX)
+            return -1;
+
+        strcat(request, " dag");
+        for (int i = 3; i < argc; i++) {
+            strcat(request, "\n");
+            strcat(request, argv[i]);
+        }
+        return 0;
+    }
 
-    for (j = 0; j < i; j++) {
-        str[j] = temp[i - j - 1];
+    // Cell and accumulator commands are sent as typed
+    if (strcmp(argv[2], "cell") == 0 || strcmp(argv[2], "acc") == 0) {
+        if (argc < 5)
+            return -1;
+        size_t length = strlen(request) + 1;
+        for (int i = 2; i < argc; i++)
+            length += strlen(argv[i]) + 1;
+        if (length >= REQUEST_MAX)
+            return -1;
+        isWatching = strcmp(argv[2], "cell") == 0 && strcmp(argv[3], "watch") == 0;
+    } else if (argc == 5 || argc == 6) {
+        // The fifth operand is the modulus of the modular operations
+        isCalculation = 1;
+    } else {
+        return -1;
     }
 
-    str[i] = '\0';
+    for (int i = 2; i < argc; i++) {
+        strcat(request, " ");
+        strcat(request, argv[i]);
+    }
+    return 0;
+}
+
+int createOperandPayload(int *count) {
+    int *num1, *num2;
+    *count = readOperandPairs(&num1, &num2);
+    if (*count < 0)
+        return -1;
+
+    // Operands go in a sealed memfd that the server maps directly, num1 values then num2 values
+    int *operands;
+    size_t operandSize = 2 * (size_t)*count * sizeof(int);
+    int operandFD = channelCreatePayload("calc_operands", operandSize, (void **)&operands);
+    if (operandFD >= 0) {
+        memcpy(operands, num1, *count * sizeof(int));
+        memcpy(operands + *count, num2, *count * sizeof(int));
+        if (channelSealPayload(operandFD, operands, operandSize) < 0)
+            operandFD = -1;
+    }
+    free(num1);
+    free(num2);
+    return operandFD;
+}
+
+int runVector(int argc, char *argv[]) {
+    // "vector op [modulus]" with one "num1 num2" pair per line on stdin
+    if (argc != 4 && argc != 5) {
+        printf("ERROR_FROM_EX2\n");
+        return -1;
+    }
+
+    int count;
+    int operandFD = createOperandPayload(&count);
+    if (operandFD < 0) {
+        perror("ERROR_FROM_EX2");
+        return -1;
+    }
+
+    // The results land in a second memfd the client keeps mapped, sealed only against resizing
+    int *results;
+    size_t resultSize = (size_t)count * sizeof(int);
+    int resultFD = channelCreatePayload("calc_results", resultSize, (void **)&results);
+    if (resultFD < 0 || channelSealDestination(resultFD) < 0) {
+        perror("ERROR_FROM_EX2");
+        return -1;
+    }
+
+    int sock = channelConnect(serverPID);
+    int fds[CHANNEL_MAX_FDS] = { operandFD, resultFD };
+    ChannelMessage message = { CHANNEL_VECTOR_INTO, atoi(argv[3]), argc == 5 ? atoi(argv[4]) : 0, count, 0 };
+    if (sock < 0 || channelSend(sock, &message, fds, CHANNEL_MAX_FDS) < 0) {
+        perror("ERROR_FROM_EX2");
+        return -1;
+    }
+    printf("Client - Sent %d operand pairs to server. end of stage d.\n", count);
+
+    // The reply only carries the status, the server already wrote into our pages
+    ChannelMessage reply;
+    if (channelReceive(sock, &reply, fds) < 0 || reply.status < 0) {
+        printf("ERROR_FROM_EX2\n");
+        return -1;
+    }
+
+    printf("Client - Received %d results from server. end of stage j.\n", count);
+    for (int i = 0; i < count; i++)
+        printf("%d\n", results[i]);
+    return 0;
+}
+
+int runStream(int argc, char *argv[]) {
+    // "stream op [modulus]", like vector but results are printed chunk by chunk as they arrive
+    if (argc != 4 && argc != 5) {
+        printf("ERROR_FROM_EX2\n");
+        return -1;
+    }
+
+    int count;
+    int operandFD = createOperandPayload(&count);
+    int sock = channelConnect(serverPID);
+    ChannelMessage message = { CHANNEL_STREAM, atoi(argv[3]), argc == 5 ? atoi(argv[4]) : 0, count, 0 };
+    ChannelMessage credit = { CHANNEL_CREDIT, 0, 0, CHANNEL_STREAM_WINDOW, 0 };
+    if (operandFD < 0 || sock < 0 || channelSend(sock, &message, &operandFD, 1) < 0 ||
+        channelSend(sock, &credit, NULL, 0) < 0) {
+        perror("ERROR_FROM_EX2");
+        return -1;
+    }
+    printf("Client - Sent %d operand pairs to server. end of stage d.\n", count);
+
+    // Each chunk consumed gives one credit back, so the server never runs more than the window ahead
+    static int chunk[CHANNEL_CHUNK_VALUES];
+    ChannelMessage reply;
+    int fds[CHANNEL_MAX_FDS];
+    credit.count = 1;
+    while (channelReceive(sock, &reply, fds) == 0 && reply.kind == CHANNEL_CHUNK) {
+        if (reply.count > CHANNEL_CHUNK_VALUES || channelReceiveData(sock, chunk, reply.count * sizeof(int)) < 0)
+            break;
+        for (uint32_t i = 0; i < reply.count; i++)
+            printf("%d\n", chunk[i]);
+        channelSend(sock, &credit, NULL, 0);
+    }
+
+    if (reply.kind != CHANNEL_RESULT || reply.status < 0 || (int)reply.count != count) {
+        printf("ERROR_FROM_EX2\n");
+        return -1;
+    }
+    printf("Client - Received %d streamed results from server. end of stage j.\n", count);
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 5) {
+    if (argc >= 3)
+        serverPID = resolveServer(argc, argv);
+    if (argc >= 3 && serverPID <= 0) {
+        printf("ERROR_FROM_EX2 - no server instance to send to\n");
+        exit(-1);
+    }
+
+    // Vector and stream requests go over the server's socket instead of toServer.txt
+    if (argc >= 3 && strcmp(argv[2], "vector") == 0)
+        return runVector(argc, argv);
+    if (argc >= 3 && strcmp(argv[2], "stream") == 0)
+        return runStream(argc, argv);
+
+    if (argc < 3 || buildRequest(argc, argv) < 0) {
         printf("ERROR_FROM_EX2\n");
         exit(-1);
     }
 
+    // A plain calculation someone already asked for is answered from the server's result cache
+    if (isCalculation) {
+        ResultCache *cache = cacheOpen(0);
+        int result;
+        if (cache != NULL && cacheLookup(cache, atoi(argv[2]), atoi(argv[3]), atoi(argv[4]),
+                                         argc == 6 ? atoi(argv[5]) : 0, &result)) {
+            printf("Client - Received result from cache: %d. end of stage j.\n", result);
+            exit(0);
+        }
+    }
+
     // Set up signal handler for SIGUSR1 to receive the result
     signal(SIGUSR1, signalHandler);
 
@@ -112,27 +444,22 @@ int main(int argc, char* argv[]) {
     }
     randomDelay %= 6; // Get a number between 0 and 5
 
+    // The server's toServer_{pid}.txt sits in the spool root shared with it
+    char requestPath[SPOOL_PATH_MAX];
+    spoolRequestPath(serverPID, requestPath);
+
     // Retry generating the file for a maximum number of times
     int retries = 0;
     while (retries < MAX_RETRIES) {
         usleep((randomDelay + 1) * 1000000); // Sleep for randomDelay seconds
 
         // Write to toServer
-        int myPID = getpid();
-        intToStr(myPID, responseFile);
-        strcat(responseFile, " ");
-        strcat(responseFile, argv[2]);
-        strcat(responseFile, " ");
-        strcat(responseFile, argv[3]);
-        strcat(responseFile, " ");
-        strcat(responseFile, argv[4]);
-
-        int toServer = open("./toServer.txt", O_WRONLY | O_CREAT | O_EXCL, 0644);
+        int toServer = open(requestPath, O_WRONLY | O_CREAT | O_EXCL, 0644);
         if (toServer == -1) {
             perror("ERROR_FROM_EX2");
             retries++;
         } else {
-            ssize_t bytesWritten = write(toServer, responseFile, strlen(responseFile));
+            ssize_t bytesWritten = write(toServer, request, strlen(request));
             if (bytesWritten == -1) {
                 perror("ERROR_FROM_EX2");
             } else {
@@ -152,7 +479,7 @@ int main(int argc, char* argv[]) {
     }
 
     // Send signal to the server
-    int processID = atoi(argv[1]);
+    int processID = serverPID;
     int result = kill(processID, SIGUSR1);
 
     if (result == 0) {
@@ -161,8 +488,10 @@ int main(int argc, char* argv[]) {
         perror("ERROR_FROM_EX2");
     }
 
-    // Wait for the response from the server
-    pause();
+    // Wait for the response from the server, watchers keep waiting for updates
+    do {
+        pause();
+    } while (isWatching);
 
     return 0;
 }
@@ -0,0 +1,186 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "codec.h"
+
+// Bytes classified per step, one bit per byte in the masks below
+#define CODEC_BLOCK 64
+#define CODEC_PAGE 4096
+
+static const char digitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Set bit i of number for every digit or '-', of minus for a '-' and of other for anything
+// that isn't one or a blank
+static void classifyBlock(const char *block, int length, uint64_t *number, uint64_t *minus, uint64_t *other) {
+    *number = 0;
+    *minus = 0;
+    *other = 0;
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i belowZero = _mm_set1_epi8('0' - 1), aboveNine = _mm_set1_epi8('9' + 1);
+    const __m128i dash = _mm_set1_epi8('-'), space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t'), carriage = _mm_set1_epi8('\r');
+    for (; i < length; i += 16) {
+        // Reading past the line is harmless while the load stays inside the same page, the
+        // extra bytes are masked off below. Only a tail that would cross a page is copied first
+        __m128i bytes;
+        if (length - i >= 16 || ((uintptr_t)(block + i) & (CODEC_PAGE - 1)) <= CODEC_PAGE - 16) {
+            bytes = _mm_loadu_si128((const __m128i *)(block + i));
+        } else {
+            char tail[16] = { 0 };
+            memcpy(tail, block + i, length - i);
+            bytes = _mm_loadu_si128((const __m128i *)tail);
+        }
+
+        __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(bytes, belowZero), _mm_cmplt_epi8(bytes, aboveNine));
+        __m128i isMinus = _mm_cmpeq_epi8(bytes, dash);
+        __m128i isNumber = _mm_or_si128(isDigit, isMinus);
+        __m128i isBlank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, space), _mm_cmpeq_epi8(bytes, tab)),
+                                       _mm_cmpeq_epi8(bytes, carriage));
+        uint64_t numberBits = (uint32_t)_mm_movemask_epi8(isNumber);
+        uint64_t knownBits = (uint32_t)_mm_movemask_epi8(_mm_or_si128(isNumber, isBlank));
+        *number |= numberBits << i;
+        *minus |= (uint64_t)(uint32_t)_mm_movemask_epi8(isMinus) << i;
+        *other |= (~knownBits & 0xFFFF) << i;
+    }
+#endif
+
+    for (; i < length; i++) {
+        char c = block[i];
+        if (c == '-')
+            *minus |= (uint64_t)1 << i;
+        if ((c >= '0' && c <= '9') || c == '-')
+            *number |= (uint64_t)1 << i;
+        else if (c != ' ' && c != '\t' && c != '\r')
+            *other |= (uint64_t)1 << i;
+    }
+
+    // Bits past the end of the line are neither
+    if (length < CODEC_BLOCK) {
+        uint64_t inLine = ((uint64_t)1 << length) - 1;
+        *number &= inLine;
+        *minus &= inLine;
+        *other &= inLine;
+    }
+}
+
+// Value of count digits, wrapping like the 32-bit arithmetic of atoi
+static uint32_t convertDigits(const char *digits, int count, const char *end) {
+    uint32_t value = 0;
+
+#if defined(__SSE2__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Leading digits beyond eight one at a time, then the last eight in parallel inside one
+    // 64-bit word: pairs, then quads, then the full eight digits, three multiplies in all
+    for (; count > 8; count--)
+        value = value * 10 + (uint32_t)(*digits++ - '0');
+
+    uint64_t lanes = 0;
+    if (end - digits >= 8 || ((uintptr_t)digits & (CODEC_PAGE - 1)) <= CODEC_PAGE - 8)
+        memcpy(&lanes, digits, 8);
+    else
+        memcpy(&lanes, digits, count);
+    lanes -= 0x3030303030303030ULL;
+    lanes <<= 8 * (8 - count);  // Drop the bytes past the number, the freed low bytes act as leading zeros
+    lanes = (lanes * 10 + (lanes >> 8)) & 0x00FF00FF00FF00FFULL;
+    lanes = (lanes * 100 + (lanes >> 16)) & 0x0000FFFF0000FFFFULL;
+    lanes = (lanes * 10000 + (lanes >> 32)) & 0xFFFFFFFFULL;
+    return value * 100000000u + (uint32_t)lanes;
+#else
+    (void)end;
+    while (count-- > 0)
+        value = value * 10 + (uint32_t)(*digits++ - '0');
+    return value;
+#endif
+}
+
+int codecParseInts(const char *begin, const char *end, int *values, int maxValues) {
+    int count = 0;
+    const char *block = begin;
+
+    while (block < end) {
+        int length = end - block < CODEC_BLOCK ? (int)(end - block) : CODEC_BLOCK;
+        uint64_t number, minus, other;
+        classifyBlock(block, length, &number, &minus, &other);
+        if (other)
+            return -1;
+
+        // Every run of set bits is one token. A run that touches the end of a full block may
+        // continue in the next one, so the next block starts at that token instead
+        const char *next = block + length;
+        while (number) {
+            int start = __builtin_ctzll(number);
+            uint64_t rest = ~(number >> start);
+            int tokenLength = rest ? __builtin_ctzll(rest) : CODEC_BLOCK - start;
+            if (start + tokenLength == length && block + length < end) {
+                if (start == 0)
+                    return -1;  // A token longer than a whole block
+                next = block + start;
+                break;
+            }
+            number &= tokenLength + start >= CODEC_BLOCK ? 0 : ~(uint64_t)0 << (start + tokenLength);
+
+            // A '-' may only lead the token
+            int isNegative = (minus >> start) & 1;
+            const char *digits = block + start + isNegative;
+            int digitCount = tokenLength - isNegative;
+            uint64_t inToken = tokenLength + start >= CODEC_BLOCK ? ~(uint64_t)0 : ((uint64_t)1 << (start + tokenLength)) - 1;
+            if (digitCount == 0 || (minus & inToken) >> start >> 1 != 0 || count == maxValues)
+                return -1;
+
+            uint32_t magnitude = convertDigits(digits, digitCount, end);
+            values[count++] = (int)(isNegative ? 0 - magnitude : magnitude);
+        }
+        block = next;
+    }
+    return count;
+}
+
+char *codecFormatBackward(int value, char *end) {
+    // Unsigned magnitude, so INT_MIN needs no special case
+    uint32_t magnitude = value < 0 ? 0 - (uint32_t)value : (uint32_t)value;
+
+    // Two digits per division, copied from the pair table
+    while (magnitude >= 100) {
+        uint32_t pair = magnitude % 100;
+        magnitude /= 100;
+        end -= 2;
+        memcpy(end, &digitPairs[pair * 2], 2);
+    }
+    if (magnitude >= 10) {
+        end -= 2;
+        memcpy(end, &digitPairs[magnitude * 2], 2);
+    } else {
+        *--end = (char)('0' + magnitude);
+    }
+
+    if (value < 0)
+        *--end = '-';
+    return end;
+}
+
+int codecFormatInt(int value, char *text) {
+    char buffer[CODEC_INT_MAX_TEXT];
+    char *start = codecFormatBackward(value, buffer + sizeof(buffer));
+    int length = buffer + sizeof(buffer) - start;
+    memcpy(text, start, length);
+    text[length] = '\0';
+    return length;
+}
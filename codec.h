@@ -0,0 +1,20 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#ifndef CODEC_H
+#define CODEC_H
+
+// Longest formatted int, "-2147483648"
+#define CODEC_INT_MAX_TEXT 11
+
+// Parse a line of integers separated by spaces, tabs or '\r', between begin and end.
+// Returns how many were stored in values, or -1 on any other character or more than maxValues
+int codecParseInts(const char *begin, const char *end, int *values, int maxValues);
+
+// Write value in decimal so it ends right before end, returns where it starts. No terminator
+char *codecFormatBackward(int value, char *end);
+
+// Write value in decimal with a terminator, returns the length
+int codecFormatInt(int value, char *text);
+
+#endif
@@ -0,0 +1,141 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "codec.h"
+
+// Benchmark of the text codec against the functions it replaced: ./codec_bench [lines]
+// Every line is also checked against the old results, so a mismatch fails the run
+
+#define BENCH_DEFAULT_LINES 1000000
+#define BENCH_FIELDS 5
+
+// The strtok/atoi parser the server used before, kept here as the baseline
+static void legacyParse(char *buffer, int *values) {
+    char *token = strtok(buffer, " ");
+    for (int i = 0; i < BENCH_FIELDS; i++) {
+        values[i] = token != NULL ? atoi(token) : 0;
+        token = strtok(NULL, " ");
+    }
+}
+
+// The old intToStr, digits one at a time and then reversed. Only right for num >= 0
+static void legacyIntToStr(int num, char *str) {
+    int i = 0, j = 0;
+    char temp[10];
+
+    if (num == 0) {
+        str[0] = '0';
+        str[1] = '\0';
+        return;
+    }
+    while (num > 0) {
+        temp[i++] = (num % 10) + '0';
+        num /= 10;
+    }
+    for (j = 0; j < i; j++)
+        str[j] = temp[i - j - 1];
+    str[i] = '\0';
+}
+
+static double seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int randomValue(void) {
+    // Mostly short numbers like real requests, with some full-width and negative ones
+    int value = rand() % 4 == 0 ? rand() : rand() % 10000;
+    return rand() % 8 == 0 ? -value : value;
+}
+
+int main(int argc, char *argv[]) {
+    int lines = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_LINES;
+    if (lines <= 0) {
+        printf("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+
+    // Request-shaped lines: "clientPID num1 op num2 modulus"
+    int *expected = malloc((size_t)lines * BENCH_FIELDS * sizeof(int));
+    size_t *lineStart = malloc(((size_t)lines + 1) * sizeof(size_t));
+    char *text = malloc((size_t)lines * BENCH_FIELDS * (CODEC_INT_MAX_TEXT + 1));
+    char *copy = malloc((size_t)lines * BENCH_FIELDS * (CODEC_INT_MAX_TEXT + 1));
+    if (expected == NULL || lineStart == NULL || text == NULL || copy == NULL) {
+        perror("ERROR_FROM_EX2\n");
+        exit(-1);
+    }
+
+    srand(1);
+    size_t size = 0;
+    for (int i = 0; i < lines; i++) {
+        lineStart[i] = size;
+        for (int f = 0; f < BENCH_FIELDS; f++) {
+            expected[i * BENCH_FIELDS + f] = randomValue();
+            size += sprintf(text + size, f == 0 ? "%d" : " %d", expected[i * BENCH_FIELDS + f]);
+        }
+        text[size++] = '\0';
+    }
+    lineStart[lines] = size;
+    memcpy(copy, text, size);
+
+    // Parsing, strtok needs a writable copy so the copy is made before the clock starts
+    int values[BENCH_FIELDS];
+    long checksum = 0;
+    double start = seconds();
+    for (int i = 0; i < lines; i++) {
+        legacyParse(copy + lineStart[i], values);
+        checksum += values[1];
+    }
+    double legacyParseTime = seconds() - start;
+
+    start = seconds();
+    for (int i = 0; i < lines; i++) {
+        const char *line = text + lineStart[i];
+        if (codecParseInts(line, text + lineStart[i + 1] - 1, values, BENCH_FIELDS) != BENCH_FIELDS ||
+            memcmp(values, &expected[i * BENCH_FIELDS], sizeof(values)) != 0) {
+            printf("ERROR_FROM_EX2 - codecParseInts disagrees on '%s'\n", line);
+            exit(-1);
+        }
+        checksum -= values[1];
+    }
+    double codecParseTime = seconds() - start;
+
+    // Formatting, the old intToStr only gets non-negative values since it can't do the rest
+    char buffer[CODEC_INT_MAX_TEXT + 1], reference[CODEC_INT_MAX_TEXT + 1];
+    int count = lines * BENCH_FIELDS;
+    start = seconds();
+    for (int i = 0; i < count; i++) {
+        legacyIntToStr(abs(expected[i]), buffer);
+        checksum += buffer[0];
+    }
+    double legacyFormatTime = seconds() - start;
+
+    start = seconds();
+    for (int i = 0; i < count; i++) {
+        codecFormatInt(abs(expected[i]), buffer);
+        checksum -= buffer[0];
+    }
+    double codecFormatTime = seconds() - start;
+
+    for (int i = 0; i < count; i++) {
+        codecFormatInt(expected[i], buffer);
+        sprintf(reference, "%d", expected[i]);
+        if (strcmp(buffer, reference) != 0) {
+            printf("ERROR_FROM_EX2 - codecFormatInt wrote '%s' for %s\n", buffer, reference);
+            exit(-1);
+        }
+    }
+
+    printf("Bench - %d lines, %zu bytes, checksum %ld\n", lines, size, checksum);
+    printf("parse   strtok/atoi      %8.2f ns/line\n", legacyParseTime * 1e9 / lines);
+    printf("parse   codecParseInts   %8.2f ns/line\n", codecParseTime * 1e9 / lines);
+    printf("format  intToStr (old)   %8.2f ns/value\n", legacyFormatTime * 1e9 / count);
+    printf("format  codecFormatInt   %8.2f ns/value\n", codecFormatTime * 1e9 / count);
+    return 0;
+}
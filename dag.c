@@ -0,0 +1,121 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "calc.h"
+#include "dag.h"
+
+int dagParse(char *lines, DagNode *nodes, int maxNodes) {
+    int count = 0;
+    char *lineState;
+
+    for (char *line = strtok_r(lines, "\n", &lineState); line != NULL; line = strtok_r(NULL, "\n", &lineState)) {
+        if (count >= maxNodes)
+            return -1;
+
+        // Tokens in request order: num1, op, num2, optional modulus
+        char *tokens[4] = { NULL, NULL, NULL, NULL };
+        char *tokenState;
+        int tokenCount = 0;
+        for (char *token = strtok_r(line, " ", &tokenState); token != NULL; token = strtok_r(NULL, " ", &tokenState)) {
+            if (tokenCount == 4)
+                return -1;
+            tokens[tokenCount++] = token;
+        }
+        if (tokenCount < 3)
+            return -1;
+
+        DagNode *node = &nodes[count];
+        char *operands[DAG_OPERANDS] = { tokens[0], tokens[2], tokens[3] };
+        node->operation = atoi(tokens[1]);
+        for (int i = 0; i < DAG_OPERANDS; i++) {
+            node->reference[i] = operands[i] != NULL && operands[i][0] == 'r';
+            if (node->reference[i])
+                node->value[i] = atoi(operands[i] + 1) - 1;
+            else
+                node->value[i] = operands[i] != NULL ? atoi(operands[i]) : 0;
+        }
+        count++;
+    }
+
+    // References may point forward, but only at nodes that exist
+    for (int n = 0; n < count; n++) {
+        for (int i = 0; i < DAG_OPERANDS; i++) {
+            if (nodes[n].reference[i] && (nodes[n].value[i] < 0 || nodes[n].value[i] >= count))
+                return -1;
+        }
+    }
+    return count;
+}
+
+// Depth of a node above its inputs, state is 0 unvisited, 1 on the current path, 2 done
+static int nodeLevel(const DagNode *nodes, int n, int *level, char *state) {
+    if (state[n] == 2)
+        return level[n];
+    if (state[n] == 1)
+        return -1;
+
+    state[n] = 1;
+    level[n] = 0;
+    for (int i = 0; i < DAG_OPERANDS; i++) {
+        if (!nodes[n].reference[i])
+            continue;
+        int dependency = nodeLevel(nodes, nodes[n].value[i], level, state);
+        if (dependency < 0)
+            return -1;
+        if (dependency + 1 > level[n])
+            level[n] = dependency + 1;
+    }
+    state[n] = 2;
+    return level[n];
+}
+
+static int evaluateNode(const DagNode *node, const int *results, int *result) {
+    int operand[DAG_OPERANDS];
+    for (int i = 0; i < DAG_OPERANDS; i++)
+        operand[i] = node->reference[i] ? results[node->value[i]] : node->value[i];
+    return computeOperation(operand[0], node->operation, operand[1], operand[2], result);
+}
+
+int dagEvaluate(const DagNode *nodes, int count, int *results) {
+    int *level = malloc(count * sizeof(int));
+    int *order = malloc(count * sizeof(int));
+    int *levelStart = calloc(count + 2, sizeof(int));
+    char *state = calloc(count, 1);
+    int status = -1;
+    if (level == NULL || order == NULL || levelStart == NULL || state == NULL)
+        goto cleanup;
+
+    int maxLevel = 0;
+    for (int n = 0; n < count; n++) {
+        if (nodeLevel(nodes, n, level, state) < 0)
+            goto cleanup;  // Cycle
+        if (level[n] > maxLevel)
+            maxLevel = level[n];
+    }
+
+    // Counting sort by level, every level only depends on the ones before it. Nodes are a
+    // single operation each, forking workers for a wide level would cost more than it saves
+    for (int n = 0; n < count; n++)
+        levelStart[level[n] + 1]++;
+    for (int l = 0; l <= maxLevel; l++)
+        levelStart[l + 1] += levelStart[l];
+    for (int n = 0; n < count; n++)
+        order[levelStart[level[n]]++] = n;
+
+    for (int i = 0; i < count; i++) {
+        int n = order[i];
+        if (evaluateNode(&nodes[n], results, &results[n]) < 0)
+            goto cleanup;
+    }
+    status = 0;
+
+cleanup:
+    free(level);
+    free(order);
+    free(levelStart);
+    free(state);
+    return status;
+}
@@ -0,0 +1,25 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#ifndef DAG_H
+#define DAG_H
+
+#define DAG_MAX_NODES 4096
+
+// Operand slots of a node: num1, num2 and the modulus of the modular operations
+#define DAG_OPERANDS 3
+
+typedef struct {
+    int operation;
+    int value[DAG_OPERANDS];      // Literal value, or the index of the referenced node
+    int reference[DAG_OPERANDS];  // 1 if value is a node index
+} DagNode;
+
+// Parse one node per line, "num1 op num2 [modulus]" where any operand may be rK,
+// the result of the K-th line. Returns the number of nodes or -1 on a malformed line
+int dagParse(char *lines, DagNode *nodes, int maxNodes);
+
+// Evaluate the nodes in dependency order. Returns -1 on a cycle or a failed operation
+int dagEvaluate(const DagNode *nodes, int count, int *results);
+
+#endif
@@ -0,0 +1,352 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "calc.h"
+#include "expr.h"
+
+// Number of binding rows evaluated together, every instruction runs across all of them
+#define EXPR_BATCH 64
+
+typedef struct {
+    const char *cursor;
+    ExprProgram *program;
+    int depth;
+} Parser;
+
+static int parseSum(Parser *parser);
+
+static void skipSpaces(Parser *parser) {
+    while (isspace((unsigned char)*parser->cursor))
+        parser->cursor++;
+}
+
+static int emit(Parser *parser, int opcode, int argument, int stackEffect) {
+    ExprProgram *program = parser->program;
+    if (program->codeLength >= EXPR_MAX_CODE)
+        return -1;
+
+    program->code[program->codeLength].opcode = opcode;
+    program->code[program->codeLength].argument = argument;
+    program->codeLength++;
+
+    parser->depth += stackEffect;
+    return parser->depth > EXPR_MAX_STACK ? -1 : 0;
+}
+
+static int variableIndex(ExprProgram *program, const char *name) {
+    for (int i = 0; i < program->varCount; i++) {
+        if (strcmp(program->varNames[i], name) == 0)
+            return i;
+    }
+    if (program->varCount >= EXPR_MAX_VARS)
+        return -1;
+    strcpy(program->varNames[program->varCount], name);
+    return program->varCount++;
+}
+
+// factor := number | name | name '(' sum ',' sum ',' sum ')' | '(' sum ')' | '-' factor
+static int parseFactor(Parser *parser) {
+    skipSpaces(parser);
+    char c = *parser->cursor;
+
+    if (c == '-') {
+        parser->cursor++;
+        if (parseFactor(parser) < 0)
+            return -1;
+        return emit(parser, EXPR_NEG, 0, 0);
+    }
+
+    if (c == '(') {
+        parser->cursor++;
+        if (parseSum(parser) < 0)
+            return -1;
+        skipSpaces(parser);
+        if (*parser->cursor != ')')
+            return -1;
+        parser->cursor++;
+        return 0;
+    }
+
+    if (isdigit((unsigned char)c)) {
+        char *end;
+        long value = strtol(parser->cursor, &end, 10);
+        parser->cursor = end;
+        return emit(parser, EXPR_PUSH_CONST, (int)value, 1);
+    }
+
+    if (isalpha((unsigned char)c) || c == '_') {
+        char name[EXPR_MAX_NAME];
+        int length = 0;
+        while (isalnum((unsigned char)*parser->cursor) || *parser->cursor == '_') {
+            if (length >= EXPR_MAX_NAME - 1)
+                return -1;
+            name[length++] = *parser->cursor++;
+        }
+        name[length] = '\0';
+
+        skipSpaces(parser);
+        if (*parser->cursor != '(') {
+            int index = variableIndex(parser->program, name);
+            return index < 0 ? -1 : emit(parser, EXPR_PUSH_VAR, index, 1);
+        }
+
+        // Modular functions take three arguments and map onto operation codes 5 and 6
+        int opcode;
+        if (strcmp(name, "mulmod") == 0)
+            opcode = EXPR_MULMOD;
+        else if (strcmp(name, "powmod") == 0)
+            opcode = EXPR_POWMOD;
+        else
+            return -1;
+
+        parser->cursor++;
+        for (int i = 0; i < 3; i++) {
+            if (parseSum(parser) < 0)
+                return -1;
+            skipSpaces(parser);
+            if (*parser->cursor != (i < 2 ? ',' : ')'))
+                return -1;
+            parser->cursor++;
+        }
+        return emit(parser, opcode, 0, -2);
+    }
+
+    return -1;
+}
+
+// product := factor (('*' | '/' | '%') factor)*
+static int parseProduct(Parser *parser) {
+    if (parseFactor(parser) < 0)
+        return -1;
+
+    while (1) {
+        skipSpaces(parser);
+        char c = *parser->cursor;
+        int opcode = c == '*' ? EXPR_MUL : c == '/' ? EXPR_DIV : c == '%' ? EXPR_MOD : -1;
+        if (opcode < 0)
+            return 0;
+        parser->cursor++;
+        if (parseFactor(parser) < 0 || emit(parser, opcode, 0, -1) < 0)
+            return -1;
+    }
+}
+
+// sum := product (('+' | '-') product)*
+static int parseSum(Parser *parser) {
+    if (parseProduct(parser) < 0)
+        return -1;
+
+    while (1) {
+        skipSpaces(parser);
+        char c = *parser->cursor;
+        int opcode = c == '+' ? EXPR_ADD : c == '-' ? EXPR_SUB : -1;
+        if (opcode < 0)
+            return 0;
+        parser->cursor++;
+        if (parseProduct(parser) < 0 || emit(parser, opcode, 0, -1) < 0)
+            return -1;
+    }
+}
+
+uint32_t exprHash(const char *text) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    while (*text) {
+        hash ^= (unsigned char)*text++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int exprCompile(const char *text, ExprProgram *program) {
+    if (strlen(text) >= EXPR_MAX_TEXT)
+        return -1;
+
+    memset(program, 0, sizeof(*program));
+    strcpy(program->text, text);
+    program->hash = exprHash(text);
+
+    Parser parser = { text, program, 0 };
+    if (parseSum(&parser) < 0)
+        return -1;
+    skipSpaces(&parser);
+    if (*parser.cursor != '\0')
+        return -1;
+
+    program->valid = 1;
+    return 0;
+}
+
+// The cache may be a mapped file, so never leave a half-copied program marked valid
+static void storeProgram(ExprProgram *slot, const ExprProgram *compiled) {
+    ExprProgram copy = *compiled;
+    copy.valid = 0;
+    slot->valid = 0;
+    atomic_signal_fence(memory_order_seq_cst);
+    *slot = copy;
+    atomic_signal_fence(memory_order_seq_cst);
+    slot->valid = 1;
+}
+
+int exprLookup(ExprCache *cache, const char *text, ExprProgram *program) {
+    uint32_t hash = exprHash(text);
+    ExprProgram *slot = &cache->entries[hash % EXPR_CACHE_SIZE];
+
+    if (slot->valid && slot->hash == hash && strcmp(slot->text, text) == 0) {
+        cache->hits++;
+        *program = *slot;
+        return 0;
+    }
+
+    // Compile aside so a syntax error doesn't evict the cached program
+    cache->misses++;
+    if (exprCompile(text, program) < 0)
+        return -1;
+    storeProgram(slot, program);
+    return 0;
+}
+
+void exprCacheValidate(ExprCache *cache) {
+    for (int i = 0; i < EXPR_CACHE_SIZE; i++) {
+        ExprProgram *program = &cache->entries[i];
+        if (!program->valid)
+            continue;
+
+        ExprProgram compiled;
+        program->text[EXPR_MAX_TEXT - 1] = '\0';
+        if (exprCompile(program->text, &compiled) < 0 || compiled.hash % EXPR_CACHE_SIZE != (uint32_t)i)
+            program->valid = 0;
+        else
+            storeProgram(program, &compiled);
+    }
+}
+
+int exprBind(const ExprProgram *program, const char *line, int *values) {
+    unsigned int bound = 0;
+
+    while (*line) {
+        while (*line == ',' || isspace((unsigned char)*line))
+            line++;
+        if (*line == '\0')
+            break;
+
+        const char *equals = strchr(line, '=');
+        if (equals == NULL)
+            return -1;
+        int length = equals - line;
+
+        int index;
+        for (index = 0; index < program->varCount; index++) {
+            if ((int)strlen(program->varNames[index]) == length &&
+                strncmp(program->varNames[index], line, length) == 0)
+                break;
+        }
+        if (index == program->varCount)
+            return -1;
+
+        char *end;
+        values[index] = (int)strtol(equals + 1, &end, 10);
+        bound |= 1u << index;
+        line = end;
+    }
+
+    return bound == (1u << program->varCount) - 1 ? 0 : -1;
+}
+
+static int modularLanes(int opcode, int *a, const int *b, const int *m, int lanes) {
+    int lane;
+
+    // Constant moduli are the common case and can use the batch kernels directly
+    for (lane = 1; lane < lanes; lane++) {
+        if (m[lane] != m[0])
+            break;
+    }
+    if (lane == lanes) {
+        if (opcode == EXPR_MULMOD)
+            return mulModBatch(a, b, a, lanes, m[0]);
+        return powModBatch(a, b, a, lanes, m[0]);
+    }
+
+    for (lane = 0; lane < lanes; lane++) {
+        int operation = opcode == EXPR_MULMOD ? OP_MULMOD : OP_POWMOD;
+        if (computeOperation(a[lane], operation, b[lane], m[lane], &a[lane]) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int exprEvaluate(const ExprProgram *program, const int *bindings, int count, int *results) {
+    int stack[EXPR_MAX_STACK][EXPR_BATCH];
+    int varCount = program->varCount;
+
+    for (int row = 0; row < count; row += EXPR_BATCH) {
+        int lanes = count - row < EXPR_BATCH ? count - row : EXPR_BATCH;
+        int top = -1;
+
+        for (int pc = 0; pc < program->codeLength; pc++) {
+            const ExprInstruction *instruction = &program->code[pc];
+            int *a = stack[top > 0 ? top - 1 : 0];
+            int *b = stack[top >= 0 ? top : 0];
+            int lane;
+
+            switch (instruction->opcode) {
+                case EXPR_PUSH_CONST:
+                    top++;
+                    for (lane = 0; lane < lanes; lane++)
+                        stack[top][lane] = instruction->argument;
+                    break;
+                case EXPR_PUSH_VAR:
+                    top++;
+                    for (lane = 0; lane < lanes; lane++)
+                        stack[top][lane] = bindings[(row + lane) * varCount + instruction->argument];
+                    break;
+                case EXPR_ADD:
+                    for (lane = 0; lane < lanes; lane++)
+                        a[lane] += b[lane];
+                    top--;
+                    break;
+                case EXPR_SUB:
+                    for (lane = 0; lane < lanes; lane++)
+                        a[lane] -= b[lane];
+                    top--;
+                    break;
+                case EXPR_MUL:
+                    for (lane = 0; lane < lanes; lane++)
+                        a[lane] *= b[lane];
+                    top--;
+                    break;
+                case EXPR_DIV:
+                case EXPR_MOD:
+                    for (lane = 0; lane < lanes; lane++) {
+                        if (b[lane] == 0 || (a[lane] == INT_MIN && b[lane] == -1))
+                            return -1;
+                        a[lane] = instruction->opcode == EXPR_DIV ? a[lane] / b[lane] : a[lane] % b[lane];
+                    }
+                    top--;
+                    break;
+                case EXPR_NEG:
+                    for (lane = 0; lane < lanes; lane++)
+                        b[lane] = -b[lane];
+                    break;
+                case EXPR_MULMOD:
+                case EXPR_POWMOD:
+                    // Operands are (top - 2, top - 1, top), the result replaces top - 2
+                    if (modularLanes(instruction->opcode, stack[top - 2], stack[top - 1], stack[top], lanes) < 0)
+                        return -1;
+                    top -= 2;
+                    break;
+                default:
+                    return -1;
+            }
+        }
+
+        memcpy(results + row, stack[0], lanes * sizeof(int));
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <stdint.h>
+
+#define EXPR_MAX_TEXT 256
+#define EXPR_MAX_CODE 96
+#define EXPR_MAX_STACK 16
+#define EXPR_MAX_VARS 8
+#define EXPR_MAX_NAME 16
+#define EXPR_CACHE_SIZE 64
+
+// Stack machine instructions
+enum {
+    EXPR_PUSH_CONST,
+    EXPR_PUSH_VAR,
+    EXPR_ADD,
+    EXPR_SUB,
+    EXPR_MUL,
+    EXPR_DIV,
+    EXPR_MOD,
+    EXPR_NEG,
+    EXPR_MULMOD,
+    EXPR_POWMOD
+};
+
+typedef struct {
+    int32_t opcode;
+    int32_t argument;  // Constant value or variable index
+} ExprInstruction;
+
+// A compiled expression, plain data with no pointers so it can be cached anywhere
+typedef struct {
+    uint32_t hash;
+    int32_t valid;
+    char text[EXPR_MAX_TEXT];
+    int32_t varCount;
+    char varNames[EXPR_MAX_VARS][EXPR_MAX_NAME];
+    int32_t codeLength;
+    ExprInstruction code[EXPR_MAX_CODE];
+} ExprProgram;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    ExprProgram entries[EXPR_CACHE_SIZE];
+} ExprCache;
+
+uint32_t exprHash(const char *text);
+
+// Parse and compile text, returns 0 on success and -1 on a syntax error
+int exprCompile(const char *text, ExprProgram *program);
+
+// Copy the cached program for text into program, compiling it on a miss. Returns -1 on a
+// syntax error. The copy stays intact whatever later happens to the cache slot
+int exprLookup(ExprCache *cache, const char *text, ExprProgram *program);
+
+// Compile every cached program again from its text, after attaching a cache that outlived its
+// writer. Bytecode read from the file is never trusted
+void exprCacheValidate(ExprCache *cache);
+
+// Fill values (varCount ints) from a "a=1,b=2" binding line, returns -1 on unknown or missing names
+int exprBind(const ExprProgram *program, const char *line, int *values);
+
+// Evaluate the program for count rows of bindings laid out row by row,
+// returns -1 if any row divides by zero or has an invalid modulus
+int exprEvaluate(const ExprProgram *program, const int *bindings, int count, int *results);
+
+#endif
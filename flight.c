@@ -0,0 +1,60 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include "flight.h"
+
+Flight *flightTableCreate(void) {
+    Flight *table = mmap(NULL, FLIGHT_MAX * sizeof(Flight), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return table == MAP_FAILED ? NULL : table;
+}
+
+Flight *flightFind(Flight *table, int num1, int operation, int num2, int modulus) {
+    for (int i = 0; i < FLIGHT_MAX; i++) {
+        Flight *flight = &table[i];
+        if (flight->isUsed && flight->num1 == num1 && flight->operation == operation &&
+            flight->num2 == num2 && flight->modulus == modulus)
+            return flight;
+    }
+    return NULL;
+}
+
+Flight *flightForChild(Flight *table, pid_t child) {
+    for (int i = 0; i < FLIGHT_MAX; i++) {
+        if (table[i].isUsed && table[i].child == child)
+            return &table[i];
+    }
+    return NULL;
+}
+
+Flight *flightStart(Flight *table, int num1, int operation, int num2, int modulus, int clientPID) {
+    for (int i = 0; i < FLIGHT_MAX; i++) {
+        Flight *flight = &table[i];
+        if (flight->isUsed)
+            continue;
+
+        memset(flight, 0, sizeof(*flight));
+        flight->isUsed = 1;
+        flight->num1 = num1;
+        flight->operation = operation;
+        flight->num2 = num2;
+        flight->modulus = modulus;
+        flight->status = -1;
+        flight->waiters[flight->waiterCount++] = clientPID;
+        return flight;
+    }
+    return NULL;
+}
+
+int flightJoin(Flight *flight, int clientPID) {
+    if (flight->waiterCount >= FLIGHT_MAX_WAITERS)
+        return -1;
+    flight->waiters[flight->waiterCount++] = clientPID;
+    return 0;
+}
+
+void flightFinish(Flight *flight) {
+    flight->isUsed = 0;
+}
@@ -0,0 +1,38 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#ifndef FLIGHT_H
+#define FLIGHT_H
+
+#include <sys/types.h>
+
+#define FLIGHT_MAX 64
+#define FLIGHT_MAX_WAITERS 32
+
+// One calculation in progress. The parent owns everything except status and result,
+// which the child computing it writes before exiting, so the table lives in shared memory
+typedef struct {
+    int isUsed;
+    pid_t child;
+    int num1, operation, num2, modulus;
+    int status;  // 0 once the child computed result, -1 if the operation failed
+    int result;
+    int waiterCount;
+    int waiters[FLIGHT_MAX_WAITERS];  // Client PIDs to answer, the first one started the flight
+} Flight;
+
+// Map a zeroed table shared with forked children, NULL on failure
+Flight *flightTableCreate(void);
+
+Flight *flightFind(Flight *table, int num1, int operation, int num2, int modulus);
+Flight *flightForChild(Flight *table, pid_t child);
+
+// Claim a slot for a new calculation, NULL if the table is full
+Flight *flightStart(Flight *table, int num1, int operation, int num2, int modulus, int clientPID);
+
+// Add another client waiting for the same result, -1 if the flight is full
+int flightJoin(Flight *flight, int clientPID);
+
+void flightFinish(Flight *flight);
+
+#endif
@@ -0,0 +1,501 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#define _GNU_SOURCE  // accept4
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "bulk.h"
+#include "calc.h"
+#include "channel.h"
+#include "registry.h"
+
+// TCP gateway for clients on other machines: ./gateway <serverPID | -> [port]
+// A connection starts with the CALCBIN1 magic followed by BulkRecord requests, and gets
+// CALCRES1 followed by one BulkResult per record, in order. Whatever records are readable
+// at once form a batch. A batch's records are grouped by operation and modulus, and each
+// group goes to the server as one vector request over its Unix socket, operands and results
+// in memfds. Several batches of a connection are in flight at once. With "-" instead of a PID
+// each group goes to the less loaded of two registered instances picked at random
+
+#define GATEWAY_PORT 5555
+#define GATEWAY_EVENTS 64
+#define GATEWAY_BUFFER (256 << 10)  // Bytes read from a connection before they are batched
+#define GATEWAY_BATCH 16384         // Records in one batch at most
+#define GATEWAY_GROUPS 32           // Vector requests one batch may need
+#define GATEWAY_PIPELINE 8          // Batches of one connection in flight
+#define GATEWAY_MAX_GROUPS 64       // Vector requests at the server at once, each one is a fork there
+
+// epoll hands back a pointer to one of these, the kind tells which
+#define KIND_LISTENER 0
+#define KIND_CONNECTION 1
+#define KIND_GROUP 2
+
+typedef struct Batch {
+    struct Batch *next;
+    int count;
+    int pendingGroups;
+    BulkResult *results;
+} Batch;
+
+typedef struct Connection {
+    int kind;
+    int fd;                   // -1 once closed, it stays allocated until its groups are back
+    int isGreeted;            // The CALCBIN1 magic has arrived
+    int isEnding;             // The client closed its side, answer what is left and close
+    char in[GATEWAY_BUFFER];
+    size_t inUsed;
+    char *out;
+    size_t outUsed, outSent, outSize;
+    Batch *head, *tail;       // Batches in arrival order, answered in that order
+    int inFlight;
+    unsigned events;          // What epoll currently waits for
+    int isReleased;
+    int isStalled;            // Has records waiting for the server to take more groups
+    struct Connection *nextClosed;
+    struct Connection *nextStalled;
+} Connection;
+
+// One vector request to the server
+typedef struct {
+    int kind;
+    int sock;
+    int operation, modulus;
+    int count;
+    int *index;               // Position of each value in the batch
+    int *num1, *num2;
+    int *results;             // Mapped destination memfd
+    Connection *connection;
+    Batch *batch;
+} Group;
+
+int epollFD;
+int serverPID;  // 0 when the groups are spread over the registered instances
+Registry *registry;
+int groupsInFlight;
+Connection *stalledConnections;
+
+// Freed after the current round of events, a later event of the round may still point at them
+Connection *closedConnections;
+
+void watch(int fd, void *owner, unsigned events, int operation) {
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = owner;
+    if (epoll_ctl(epollFD, operation, fd, &event) < 0)
+        perror("ERROR_FROM_EX2 - epoll_ctl");
+}
+
+void setInterest(Connection *connection, unsigned events) {
+    if (connection->events != events) {
+        watch(connection->fd, connection, events, EPOLL_CTL_MOD);
+        connection->events = events;
+    }
+}
+
+void closeConnection(Connection *connection) {
+    if (connection->fd >= 0) {
+        epoll_ctl(epollFD, EPOLL_CTL_DEL, connection->fd, NULL);
+        close(connection->fd);
+        connection->fd = -1;
+    }
+
+    if (connection->isStalled) {
+        Connection **link = &stalledConnections;
+        while (*link != connection)
+            link = &(*link)->nextStalled;
+        *link = connection->nextStalled;
+        connection->isStalled = 0;
+    }
+
+    // Groups still at the server come back to it, the last one releases it
+    if (connection->inFlight == 0 && !connection->isReleased) {
+        connection->isReleased = 1;
+        connection->nextClosed = closedConnections;
+        closedConnections = connection;
+    }
+}
+
+void releaseClosedConnections(void) {
+    while (closedConnections != NULL) {
+        Connection *connection = closedConnections;
+        closedConnections = connection->nextClosed;
+        free(connection->out);
+        free(connection);
+    }
+}
+
+void queueOutput(Connection *connection, const void *data, size_t size) {
+    if (connection->outUsed + size > connection->outSize) {
+        size_t newSize = connection->outSize * 2 > connection->outUsed + size ? connection->outSize * 2 : connection->outUsed + size;
+        char *out = realloc(connection->out, newSize);
+        if (out == NULL) {
+            perror("ERROR_FROM_EX2\n");
+            exit(1);
+        }
+        connection->out = out;
+        connection->outSize = newSize;
+    }
+    memcpy(connection->out + connection->outUsed, data, size);
+    connection->outUsed += size;
+}
+
+// Write what the socket takes now, the rest waits for EPOLLOUT
+int flushOutput(Connection *connection) {
+    while (connection->outSent < connection->outUsed) {
+        ssize_t sent = send(connection->fd, connection->out + connection->outSent, connection->outUsed - connection->outSent,
+                            MSG_NOSIGNAL);
+        if (sent < 0 && errno == EAGAIN)
+            break;
+        if (sent <= 0)
+            return -1;
+        connection->outSent += sent;
+    }
+    if (connection->outSent == connection->outUsed)
+        connection->outSent = connection->outUsed = 0;
+    return 0;
+}
+
+// Queue every complete batch at the front, answers leave in the order the requests came
+void answerBatches(Connection *connection) {
+    while (connection->head != NULL && connection->head->pendingGroups == 0) {
+        Batch *batch = connection->head;
+        if (connection->fd >= 0)
+            queueOutput(connection, batch->results, batch->count * sizeof(BulkResult));
+        connection->head = batch->next;
+        if (connection->head == NULL)
+            connection->tail = NULL;
+        connection->inFlight--;
+        free(batch->results);
+        free(batch);
+    }
+}
+
+int sendGroup(Group *group) {
+    // num1 values then num2 values, sealed, plus a destination the server writes into
+    int *operands;
+    size_t operandSize = 2 * (size_t)group->count * sizeof(int);
+    int operandFD = channelCreatePayload("gateway_operands", operandSize, (void **)&operands);
+    if (operandFD < 0)
+        return -1;
+    memcpy(operands, group->num1, group->count * sizeof(int));
+    memcpy(operands + group->count, group->num2, group->count * sizeof(int));
+
+    size_t resultSize = (size_t)group->count * sizeof(int);
+    int resultFD = channelCreatePayload("gateway_results", resultSize, (void **)&group->results);
+    if (resultFD < 0)
+        group->results = NULL;
+    int pid = serverPID != 0 ? serverPID : registryChoose(registry);
+    group->sock = pid > 0 ? channelConnect(pid) : -1;
+    int fds[CHANNEL_MAX_FDS] = { operandFD, resultFD };
+    ChannelMessage message = { CHANNEL_VECTOR_INTO, group->operation, group->modulus, group->count, 0 };
+    int status = channelSealPayload(operandFD, operands, operandSize) < 0 || resultFD < 0 || group->sock < 0 ||
+                 channelSealDestination(resultFD) < 0 || channelSend(group->sock, &message, fds, CHANNEL_MAX_FDS) < 0
+                 ? -1 : 0;
+    close(operandFD);
+    if (resultFD >= 0)
+        close(resultFD);
+    if (status == 0) {
+        watch(group->sock, group, EPOLLIN, EPOLL_CTL_ADD);
+        groupsInFlight++;
+    }
+    return status;
+}
+
+void freeGroup(Group *group) {
+    if (group->sock >= 0) {
+        epoll_ctl(epollFD, EPOLL_CTL_DEL, group->sock, NULL);
+        close(group->sock);
+    }
+    if (group->results != NULL)
+        munmap(group->results, (size_t)group->count * sizeof(int));
+    free(group->index);
+    free(group->num1);
+    free(group->num2);
+    free(group);
+}
+
+// The server wrote the group's results into our mapping, the reply only carries the status
+void finishGroup(Group *group) {
+    ChannelMessage reply;
+    int fds[CHANNEL_MAX_FDS];
+    int fdCount = channelReceive(group->sock, &reply, fds);
+    for (int i = 0; i < fdCount; i++)
+        close(fds[i]);
+
+    int status = fdCount < 0 || reply.kind != CHANNEL_RESULT ? -1 : reply.status;
+    BulkResult *results = group->batch->results;
+    for (int i = 0; i < group->count; i++) {
+        results[group->index[i]].result = status == 0 ? group->results[i] : 0;
+        results[group->index[i]].status = status;
+    }
+
+    Connection *connection = group->connection;
+    group->batch->pendingGroups--;
+    groupsInFlight--;
+    freeGroup(group);
+    answerBatches(connection);
+    if (connection->fd < 0)
+        closeConnection(connection);
+}
+
+// Split the records into groups sharing an operation and modulus, stopping early when one more
+// group would be needed. Returns how many records the batch took
+int dispatchBatch(Connection *connection, const BulkRecord *records, int available) {
+    Batch *batch = calloc(1, sizeof(Batch));
+    Group *groups[GATEWAY_GROUPS];
+    int groupCount = 0, count = 0;
+    int limit = available < GATEWAY_BATCH ? available : GATEWAY_BATCH;
+    if (batch == NULL || (batch->results = calloc(limit, sizeof(BulkResult))) == NULL) {
+        perror("ERROR_FROM_EX2\n");
+        exit(1);
+    }
+
+    for (; count < limit; count++) {
+        const BulkRecord *record = &records[count];
+
+        // Invalid records are answered here, the server would fail their whole group
+        if (checkOperation(record->num1, record->operation, record->num2, record->modulus) < 0) {
+            batch->results[count].status = -1;
+            continue;
+        }
+
+        int modulus = record->operation == OP_MULMOD || record->operation == OP_POWMOD ? record->modulus : 0;
+        int g = groupCount - 1;
+        while (g >= 0 && (groups[g]->operation != record->operation || groups[g]->modulus != modulus))
+            g--;
+        if (g < 0) {
+            if (groupCount == GATEWAY_GROUPS)
+                break;
+            Group *group = calloc(1, sizeof(Group));
+            if (group == NULL || (group->index = malloc(limit * sizeof(int))) == NULL ||
+                (group->num1 = malloc(limit * sizeof(int))) == NULL || (group->num2 = malloc(limit * sizeof(int))) == NULL) {
+                perror("ERROR_FROM_EX2\n");
+                exit(1);
+            }
+            group->kind = KIND_GROUP;
+            group->sock = -1;
+            group->operation = record->operation;
+            group->modulus = modulus;
+            group->connection = connection;
+            group->batch = batch;
+            groups[groupCount] = group;
+            g = groupCount++;
+        }
+
+        Group *group = groups[g];
+        group->index[group->count] = count;
+        group->num1[group->count] = record->num1;
+        group->num2[group->count] = record->num2;
+        group->count++;
+    }
+
+    batch->count = count;
+    batch->pendingGroups = groupCount;
+    if (connection->tail != NULL)
+        connection->tail->next = batch;
+    else
+        connection->head = batch;
+    connection->tail = batch;
+    connection->inFlight++;
+
+    for (int g = 0; g < groupCount; g++) {
+        if (sendGroup(groups[g]) < 0) {
+            // No server to ask, these records fail
+            printf("ERROR_FROM_EX2 - server unreachable\n");
+            for (int i = 0; i < groups[g]->count; i++)
+                batch->results[groups[g]->index[i]].status = -1;
+            batch->pendingGroups--;
+            freeGroup(groups[g]);
+        }
+    }
+    return count;
+}
+
+// Read what has arrived and turn the complete records into batches while the pipeline has room
+void serveInput(Connection *connection) {
+    while (!connection->isEnding && connection->inUsed < GATEWAY_BUFFER) {
+        ssize_t received = recv(connection->fd, connection->in + connection->inUsed, GATEWAY_BUFFER - connection->inUsed, 0);
+        if (received < 0 && errno == EAGAIN)
+            break;
+        if (received <= 0) {
+            connection->isEnding = 1;
+            break;
+        }
+        connection->inUsed += received;
+    }
+
+    size_t consumed = 0;
+    if (!connection->isGreeted && connection->inUsed >= BULK_MAGIC_SIZE) {
+        if (memcmp(connection->in, BULK_BINARY_MAGIC, BULK_MAGIC_SIZE) != 0) {
+            printf("ERROR_FROM_EX2 - not a CALCBIN1 stream\n");
+            closeConnection(connection);
+            return;
+        }
+        connection->isGreeted = 1;
+        consumed = BULK_MAGIC_SIZE;
+        queueOutput(connection, BULK_RESULT_MAGIC, BULK_MAGIC_SIZE);
+    }
+
+    while (connection->isGreeted && connection->inFlight < GATEWAY_PIPELINE) {
+        int available = (connection->inUsed - consumed) / sizeof(BulkRecord);
+        if (available == 0)
+            break;
+
+        // The server is busy enough, go on when some group of any connection comes back
+        if (groupsInFlight + GATEWAY_GROUPS > GATEWAY_MAX_GROUPS) {
+            if (!connection->isStalled) {
+                connection->isStalled = 1;
+                connection->nextStalled = stalledConnections;
+                stalledConnections = connection;
+            }
+            break;
+        }
+        consumed += dispatchBatch(connection, (const BulkRecord *)(connection->in + consumed), available) * sizeof(BulkRecord);
+    }
+    memmove(connection->in, connection->in + consumed, connection->inUsed - consumed);
+    connection->inUsed -= consumed;
+    answerBatches(connection);
+}
+
+// Wait for input only while there is room for it, for output only while some is queued
+void updateConnection(Connection *connection) {
+    if (flushOutput(connection) < 0) {
+        closeConnection(connection);
+        return;
+    }
+
+    // A partial record at the end is dropped, like a truncated bulk file
+    if (connection->isEnding && connection->head == NULL && connection->outUsed == 0 &&
+        (!connection->isGreeted || connection->inUsed < sizeof(BulkRecord))) {
+        closeConnection(connection);
+        return;
+    }
+
+    unsigned events = 0;
+    if (!connection->isEnding && connection->inUsed < GATEWAY_BUFFER && connection->inFlight < GATEWAY_PIPELINE)
+        events |= EPOLLIN;
+    if (connection->outUsed > 0)
+        events |= EPOLLOUT;
+    setInterest(connection, events);
+}
+
+// Give the connections that waited for the server another go, while it has room
+void resumeStalledConnections(void) {
+    while (stalledConnections != NULL && groupsInFlight + GATEWAY_GROUPS <= GATEWAY_MAX_GROUPS) {
+        Connection *connection = stalledConnections;
+        stalledConnections = connection->nextStalled;
+        connection->isStalled = 0;
+        if (connection->fd >= 0)
+            serveInput(connection);
+        if (connection->fd >= 0)
+            updateConnection(connection);
+    }
+}
+
+void acceptConnections(int listener) {
+    int fd;
+    while ((fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        Connection *connection = calloc(1, sizeof(Connection));
+        if (connection == NULL) {
+            close(fd);
+            continue;
+        }
+        connection->kind = KIND_CONNECTION;
+        connection->fd = fd;
+        connection->events = EPOLLIN;
+        watch(fd, connection, EPOLLIN, EPOLL_CTL_ADD);
+    }
+}
+
+int listenTCP(int port) {
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int on = 1;
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (listener < 0 || setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+        bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0) {
+        perror("ERROR_FROM_EX2\n");
+        exit(1);
+    }
+    return listener;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2 && argc != 3) {
+        printf("ERROR_FROM_EX2\n");
+        exit(0);
+    }
+    int port = argc == 3 ? atoi(argv[2]) : GATEWAY_PORT;
+    if (strcmp(argv[1], "-") != 0)
+        serverPID = atoi(argv[1]);
+    else if ((registry = registryOpen()) == NULL) {
+        perror("ERROR_FROM_EX2 - instance registry unavailable");
+        exit(1);
+    }
+
+    int listenerKind = KIND_LISTENER;
+    int listener = listenTCP(port);
+    epollFD = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFD < 0) {
+        perror("ERROR_FROM_EX2\n");
+        exit(1);
+    }
+    watch(listener, &listenerKind, EPOLLIN, EPOLL_CTL_ADD);
+    if (serverPID != 0)
+        printf("Gateway - Listening on port %d for server %d.\n", port, serverPID);
+    else
+        printf("Gateway - Listening on port %d for the registered server instances.\n", port);
+    fflush(stdout);
+
+    struct epoll_event events[GATEWAY_EVENTS];
+    while (1) {
+        int ready = epoll_wait(epollFD, events, GATEWAY_EVENTS, -1);
+        if (ready < 0 && errno != EINTR) {
+            perror("ERROR_FROM_EX2\n");
+            exit(1);
+        }
+
+        for (int i = 0; i < ready; i++) {
+            int kind = *(int *)events[i].data.ptr;
+            if (kind == KIND_LISTENER) {
+                acceptConnections(listener);
+            } else if (kind == KIND_GROUP) {
+                Group *group = events[i].data.ptr;
+                Connection *connection = group->connection;
+                finishGroup(group);
+
+                // The pipeline has room again, records already read can go out
+                if (connection->fd >= 0)
+                    serveInput(connection);
+                if (connection->fd >= 0)
+                    updateConnection(connection);
+            } else {
+                Connection *connection = events[i].data.ptr;
+                if (connection->fd >= 0 && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                    serveInput(connection);
+                if (connection->fd >= 0)
+                    updateConnection(connection);
+            }
+        }
+        resumeStalledConnections();
+        releaseClosedConnections();
+    }
+    return 0;
+}
@@ -0,0 +1,244 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+
+#define RECORD_ALIGN 8
+
+static uint32_t checksum(const char *text, uint32_t length) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Start time of a process in clock ticks since boot, field 22 of /proc/<pid>/stat, or 0 if
+// there is no such process. The command name may hold spaces, the fields start after its ')'
+static uint32_t processStart(int pid) {
+    char path[32], stat[512];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    ssize_t length = read(fd, stat, sizeof(stat) - 1);
+    close(fd);
+    if (length <= 0)
+        return 0;
+    stat[length] = '\0';
+
+    char *field = strrchr(stat, ')');
+    for (int i = 2; field != NULL && i < 22; i++)
+        field = strchr(field + 1, ' ');
+    return field != NULL ? (uint32_t)strtoull(field + 1, NULL, 10) : 0;
+}
+
+static uint32_t firstRecord(void) {
+    return (sizeof(JournalHeader) + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+}
+
+static uint32_t recordSize(uint32_t length) {
+    return (sizeof(JournalRecord) + length + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+}
+
+static JournalRecord *recordAt(Journal *journal, uint32_t offset) {
+    return (JournalRecord *)((char *)journal->header + offset);
+}
+
+// Walk the records of the current generation, claiming a slot for each one still pending.
+// The walk stops at the first record that isn't whole, that is where appending continues
+static void recover(Journal *journal) {
+    JournalHeader *header = journal->header;
+    memset(header->slots, 0, sizeof(header->slots));
+    atomic_store(&header->inFlight, 0);
+
+    uint32_t offset = firstRecord(), claimed = 0;
+    while (offset + sizeof(JournalRecord) <= JOURNAL_SIZE) {
+        JournalRecord *record = recordAt(journal, offset);
+        if ((record->state != JOURNAL_PENDING && record->state != JOURNAL_DONE) ||
+            record->generation != header->generation || record->length > JOURNAL_SIZE - offset - sizeof(JournalRecord) ||
+            record->checksum != checksum(record->text, record->length))
+            break;
+
+        if (record->state == JOURNAL_PENDING && claimed < JOURNAL_MAX_PENDING) {
+            JournalSlot *slot = &header->slots[claimed++];
+            atomic_store(&slot->clientPID, record->clientPID);
+            slot->offset = offset;
+            atomic_fetch_add(&header->inFlight, 1);
+        }
+        offset += recordSize(record->length);
+    }
+    header->tail = offset;
+}
+
+Journal *journalOpen(void) {
+    const char *path = getenv(JOURNAL_ENV);
+    if (path == NULL || path[0] == '\0')
+        return NULL;
+
+    int fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+        return NULL;
+
+    // One server per log: a second one would replay and complete the first one's live records
+    // and append through the same tail. The lock lasts as long as the descriptor
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    if (fcntl(fd, F_SETLK, &lock) < 0) {
+        close(fd);
+        errno = EBUSY;
+        return NULL;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) < 0) {
+        close(fd);
+        return NULL;
+    }
+    if (fileStat.st_size != JOURNAL_SIZE && ftruncate(fd, JOURNAL_SIZE) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    JournalHeader *header = mmap(NULL, JOURNAL_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    Journal *journal = malloc(sizeof(Journal));
+    if (header == MAP_FAILED || journal == NULL) {
+        if (header != MAP_FAILED)
+            munmap(header, JOURNAL_SIZE);
+        free(journal);
+        close(fd);
+        return NULL;
+    }
+    journal->fd = fd;
+    journal->header = header;
+
+    // A new or foreign file starts empty
+    if (header->magic != JOURNAL_MAGIC) {
+        memset(header, 0, sizeof(JournalHeader));
+        header->magic = JOURNAL_MAGIC;
+        header->generation = 1;
+    }
+    recover(journal);
+    return journal;
+}
+
+int journalAppend(Journal *journal, const char *text, int clientPID) {
+    JournalHeader *header = journal->header;
+
+    // Once nothing is pending the old records are dead, the log starts over at the beginning
+    if (atomic_load(&header->inFlight) == 0 && header->tail != firstRecord()) {
+        header->generation++;
+        header->tail = firstRecord();
+    }
+
+    uint32_t length = strlen(text);
+    uint32_t size = recordSize(length);
+    if (size > JOURNAL_SIZE - header->tail)
+        return -1;
+
+    JournalSlot *slot = NULL;
+    for (int i = 0; i < JOURNAL_MAX_PENDING && slot == NULL; i++) {
+        if (atomic_load(&header->slots[i].clientPID) == 0)
+            slot = &header->slots[i];
+    }
+    if (slot == NULL)
+        return -1;
+
+    JournalRecord *record = recordAt(journal, header->tail);
+    record->state = JOURNAL_PENDING;
+    record->generation = header->generation;
+    record->length = length;
+    record->clientPID = clientPID;
+    record->checksum = checksum(text, length);
+    record->clientStart = processStart(clientPID);
+    memcpy(record->text, text, length);
+
+    slot->offset = header->tail;
+    atomic_store(&slot->worker, 0);
+    atomic_store(&slot->clientPID, clientPID);
+    atomic_fetch_add(&header->inFlight, 1);
+    header->tail += size;
+    return 0;
+}
+
+int journalCommit(Journal *journal) {
+    return fdatasync(journal->fd);
+}
+
+void journalSetWorker(Journal *journal, int clientPID, int worker) {
+    for (int i = 0; i < JOURNAL_MAX_PENDING; i++) {
+        JournalSlot *slot = &journal->header->slots[i];
+        if (atomic_load(&slot->clientPID) == clientPID && atomic_load(&slot->worker) == 0) {
+            atomic_store(&slot->worker, worker);
+            return;
+        }
+    }
+}
+
+// Whoever clears the slot first writes the marker, so a request completes exactly once
+static void completeSlot(Journal *journal, JournalSlot *slot, int clientPID) {
+    if (!atomic_compare_exchange_strong(&slot->clientPID, &clientPID, 0))
+        return;
+    recordAt(journal, slot->offset)->state = JOURNAL_DONE;
+    atomic_store(&slot->worker, 0);
+    atomic_fetch_sub(&journal->header->inFlight, 1);
+}
+
+void journalComplete(Journal *journal, int clientPID) {
+    for (int i = 0; i < JOURNAL_MAX_PENDING; i++) {
+        JournalSlot *slot = &journal->header->slots[i];
+        if (atomic_load(&slot->clientPID) == clientPID) {
+            completeSlot(journal, slot, clientPID);
+            return;
+        }
+    }
+}
+
+void journalCompleteWorker(Journal *journal, int worker) {
+    for (int i = 0; i < JOURNAL_MAX_PENDING; i++) {
+        JournalSlot *slot = &journal->header->slots[i];
+        int clientPID = atomic_load(&slot->clientPID);
+        if (clientPID != 0 && atomic_load(&slot->worker) == worker) {
+            completeSlot(journal, slot, clientPID);
+            return;
+        }
+    }
+}
+
+int journalReplay(Journal *journal, void (*dispatch)(char *buffer)) {
+    // recover claimed the slots in log order, so walking them replays oldest first
+    int stale = 0;
+    for (int i = 0; i < JOURNAL_MAX_PENDING; i++) {
+        JournalSlot *slot = &journal->header->slots[i];
+        int clientPID = atomic_load(&slot->clientPID);
+        if (clientPID == 0)
+            continue;
+        JournalRecord *record = recordAt(journal, slot->offset);
+
+        // Answering would signal whoever has the PID now, SIGUSR1 would kill a stranger
+        if (record->clientStart == 0 || processStart(clientPID) != record->clientStart) {
+            completeSlot(journal, slot, clientPID);
+            stale++;
+            continue;
+        }
+        char *buffer = malloc(record->length + 1);
+        if (buffer == NULL)
+            continue;
+        memcpy(buffer, record->text, record->length);
+        buffer[record->length] = '\0';
+        dispatch(buffer);
+    }
+    return stale;
+}
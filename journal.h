@@ -0,0 +1,78 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Durable request log, enabled by naming its file in IPC_JOURNAL. Requests are appended to a
+// mapped file and made durable in groups, one fdatasync for up to JOURNAL_GROUP requests or
+// whatever arrived within JOURNAL_COMMIT_USEC. Requests without a completion marker are
+// replayed when the server starts again
+#define JOURNAL_ENV "IPC_JOURNAL"
+#define JOURNAL_SIZE (16u << 20)
+#define JOURNAL_MAGIC 0x4a524e31u  // "JRN1"
+#define JOURNAL_MAX_PENDING 256
+#define JOURNAL_GROUP 32
+#define JOURNAL_COMMIT_USEC 2000
+
+// Record states, a record is written PENDING and flipped to DONE once it was answered
+#define JOURNAL_PENDING 0x444e4550u  // "PEND"
+#define JOURNAL_DONE 0x454e4f44u     // "DONE"
+
+// A request that isn't complete yet, children mark their own request through this table
+typedef struct {
+    atomic_int clientPID;  // 0 if the slot is free
+    atomic_int worker;     // Child computing it, 0 if none
+    uint32_t offset;       // Record in the log
+} JournalSlot;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t generation;  // Bumped whenever the log restarts at the beginning
+    uint32_t tail;        // Where the next record goes
+    atomic_int inFlight;  // Records still PENDING
+    JournalSlot slots[JOURNAL_MAX_PENDING];
+} JournalHeader;
+
+typedef struct {
+    uint32_t state;
+    uint32_t generation;  // Records of older generations are garbage past the tail
+    uint32_t length;
+    int32_t clientPID;
+    uint32_t checksum;    // FNV-1a of the text, a torn record ends the replay
+    uint32_t clientStart; // Low bits of the client's start time, tells a reused PID apart
+    char text[];          // The request exactly as it was read from toServer.txt
+} JournalRecord;
+
+typedef struct {
+    int fd;
+    JournalHeader *header;
+} Journal;
+
+// Open or create the log named by IPC_JOURNAL, NULL if unset or unavailable. errno is EBUSY
+// when another server has the log open. The pending records of the previous run are claimed
+// again for the replay
+Journal *journalOpen(void);
+
+// Append a request, returns -1 if the log or the pending table is full. Not durable before journalCommit
+int journalAppend(Journal *journal, const char *text, int clientPID);
+
+// Make everything appended so far durable, one fdatasync
+int journalCommit(Journal *journal);
+
+// Record the child computing the request of clientPID
+void journalSetWorker(Journal *journal, int clientPID, int worker);
+
+// Mark the request of clientPID, or the one computed by worker, complete. Safe from any process
+void journalComplete(Journal *journal, int clientPID);
+void journalCompleteWorker(Journal *journal, int worker);
+
+// Hand a copy of every pending request to dispatch, oldest first. Requests whose client is
+// gone, or whose PID now belongs to another process, are completed without an answer.
+// Returns how many of those there were
+int journalReplay(Journal *journal, void (*dispatch)(char *buffer));
+
+#endif
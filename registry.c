@@ -0,0 +1,242 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+
+#include "registry.h"
+
+Registry *registryOpen(void) {
+    int fd = shm_open(REGISTRY_NAME, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+        return NULL;
+
+    // Growing a new object is harmless to one someone else already sized
+    struct stat objectStat;
+    if (fstat(fd, &objectStat) < 0 || (objectStat.st_size < (off_t)sizeof(Registry) && ftruncate(fd, sizeof(Registry)) < 0)) {
+        close(fd);
+        return NULL;
+    }
+    Registry *registry = mmap(NULL, sizeof(Registry), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (registry == MAP_FAILED)
+        return NULL;
+
+    unsigned magic = 0;
+    if (!atomic_compare_exchange_strong(&registry->magic, &magic, REGISTRY_MAGIC) && magic != REGISTRY_MAGIC) {
+        munmap(registry, sizeof(Registry));
+        return NULL;
+    }
+    return registry;
+}
+
+static int isGone(int pid) {
+    return kill(pid, 0) < 0 && errno == ESRCH;
+}
+
+int registryJoin(Registry *registry) {
+    int self = getpid();
+    for (int i = 0; i < REGISTRY_MAX_INSTANCES; i++) {
+        int pid = atomic_load(&registry->slots[i].pid);
+        if ((pid == 0 || isGone(pid)) && atomic_compare_exchange_strong(&registry->slots[i].pid, &pid, self)) {
+            atomic_store(&registry->slots[i].load, 0);
+            atomic_fetch_add(&registry->generation, 1);
+            return i;
+        }
+    }
+    return -1;
+}
+
+// The pins are only touched under pinLock. A holder that died is taken over, and an exit
+// handler that interrupted this process's own update goes ahead
+static void lockPins(Registry *registry) {
+    int self = getpid();
+    while (1) {
+        int holder = 0;
+        if (atomic_compare_exchange_strong(&registry->pinLock, &holder, self) || holder == self)
+            return;
+        if (isGone(holder) && atomic_compare_exchange_strong(&registry->pinLock, &holder, self))
+            return;
+        sched_yield();
+    }
+}
+
+static void unlockPins(Registry *registry) {
+    atomic_store(&registry->pinLock, 0);
+}
+
+static RegistryPin *findPin(Registry *registry, int kind, int key) {
+    for (int i = 0; i < REGISTRY_PINS; i++) {
+        RegistryPin *pin = &registry->pins[i];
+        if (pin->pid != 0 && pin->kind == kind && pin->key == key)
+            return pin;
+    }
+    return NULL;
+}
+
+void registryLeave(Registry *registry, int slot) {
+    // Forked children run the same exit handlers, only the owner matches
+    int self = getpid();
+    if (slot < 0 || !atomic_compare_exchange_strong(&registry->slots[slot].pid, &self, 0))
+        return;
+    atomic_fetch_add(&registry->generation, 1);
+
+    lockPins(registry);
+    for (int i = 0; i < REGISTRY_PINS; i++) {
+        if (registry->pins[i].pid == self)
+            registry->pins[i].pid = 0;
+    }
+    unlockPins(registry);
+}
+
+void registrySetLoad(Registry *registry, int slot, int load) {
+    if (slot >= 0)
+        atomic_store_explicit(&registry->slots[slot].load, load, memory_order_relaxed);
+}
+
+uint32_t registryHash(uint32_t key) {
+    key ^= key >> 16;
+    key *= 0x85ebca6bu;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35u;
+    key ^= key >> 16;
+    return key;
+}
+
+static int comparePoints(const void *a, const void *b) {
+    uint32_t first = ((const RegistryPoint *)a)->point, second = ((const RegistryPoint *)b)->point;
+    return first < second ? -1 : first > second;
+}
+
+// The generation is read before the slots, a change during the scan shows up next time
+static void buildRing(RegistryRing *ring) {
+    ring->generation = atomic_load(&ring->registry->generation);
+    ring->count = 0;
+    for (int i = 0; i < REGISTRY_MAX_INSTANCES; i++) {
+        int pid = atomic_load(&ring->registry->slots[i].pid);
+        if (pid == 0)
+            continue;
+        for (int v = 0; v < REGISTRY_VNODES; v++) {
+            ring->points[ring->count].point = registryHash((uint32_t)pid * REGISTRY_VNODES + v);
+            ring->points[ring->count].pid = pid;
+            ring->count++;
+        }
+    }
+    qsort(ring->points, ring->count, sizeof(RegistryPoint), comparePoints);
+}
+
+// An instance that crashed never left, whoever notices frees its slot
+static void dropInstance(Registry *registry, int pid) {
+    for (int i = 0; i < REGISTRY_MAX_INSTANCES; i++) {
+        int expected = pid;
+        if (atomic_compare_exchange_strong(&registry->slots[i].pid, &expected, 0))
+            atomic_fetch_add(&registry->generation, 1);
+    }
+}
+
+int registryRoute(RegistryRing *ring, uint32_t key) {
+    uint32_t point = registryHash(key);
+    while (1) {
+        if (ring->count == 0 || ring->generation != atomic_load(&ring->registry->generation))
+            buildRing(ring);
+        if (ring->count == 0)
+            return -1;
+
+        // First point at or after the key's, wrapping around to the start of the ring
+        int low = 0, high = ring->count;
+        while (low < high) {
+            int middle = (low + high) / 2;
+            if (ring->points[middle].point < point)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        int pid = ring->points[low == ring->count ? 0 : low].pid;
+        if (!isGone(pid))
+            return pid;
+        dropInstance(ring->registry, pid);
+    }
+}
+
+int registryRouteState(RegistryRing *ring, int kind, int key) {
+    lockPins(ring->registry);
+    RegistryPin *pin = findPin(ring->registry, kind, key);
+    int pid = pin != NULL ? pin->pid : 0;
+    unlockPins(ring->registry);
+    if (pid != 0 && !isGone(pid))
+        return pid;
+    return registryRoute(ring, key);
+}
+
+int registryClaim(Registry *registry, int kind, int key) {
+    int self = getpid();
+    lockPins(registry);
+    RegistryPin *pin = findPin(registry, kind, key);
+    if (pin != NULL && pin->pid != self && !isGone(pin->pid)) {
+        int holder = pin->pid;
+        unlockPins(registry);
+        return holder;
+    }
+
+    // A new key takes a free entry, or else one left by an instance that died
+    for (int i = 0; pin == NULL && i < REGISTRY_PINS; i++) {
+        if (registry->pins[i].pid == 0)
+            pin = &registry->pins[i];
+    }
+    for (int i = 0; pin == NULL && i < REGISTRY_PINS; i++) {
+        if (isGone(registry->pins[i].pid))
+            pin = &registry->pins[i];
+    }
+    if (pin == NULL) {
+        unlockPins(registry);
+        return -1;
+    }
+    pin->pid = self;
+    pin->kind = kind;
+    pin->key = key;
+    unlockPins(registry);
+    return self;
+}
+
+void registryRelease(Registry *registry, int kind, int key) {
+    int self = getpid();
+    lockPins(registry);
+    RegistryPin *pin = findPin(registry, kind, key);
+    if (pin != NULL && pin->pid == self)
+        pin->pid = 0;
+    unlockPins(registry);
+}
+
+int registryChoose(Registry *registry) {
+    while (1) {
+        int live[REGISTRY_MAX_INSTANCES], count = 0;
+        for (int i = 0; i < REGISTRY_MAX_INSTANCES; i++) {
+            if (atomic_load(&registry->slots[i].pid) != 0)
+                live[count++] = i;
+        }
+        if (count == 0)
+            return -1;
+
+        // Two different slots, the second one offset from the first so they never coincide
+        uint32_t random[2] = { 0, 0 };
+        if (getrandom(random, sizeof(random), 0) != sizeof(random))
+            random[0] = random[1] = getpid();
+        int first = live[random[0] % count];
+        int second = count > 1 ? live[(random[0] % count + 1 + random[1] % (count - 1)) % count] : first;
+        int chosen = atomic_load_explicit(&registry->slots[second].load, memory_order_relaxed) <
+                     atomic_load_explicit(&registry->slots[first].load, memory_order_relaxed) ? second : first;
+
+        int pid = atomic_load(&registry->slots[chosen].pid);
+        if (pid != 0 && !isGone(pid))
+            return pid;
+        if (pid != 0)
+            dropInstance(registry, pid);
+    }
+}
@@ -0,0 +1,97 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Shared-memory list of the server instances running on this host. Each server claims a slot
+// on startup, keeps its queue depth there up to date and frees the slot on exit. Clients and
+// the gateway read it to pick an instance. All zeroes is an empty registry, so whoever
+// creates the object first needs no setup
+#define REGISTRY_NAME "/ipc_calc_registry"
+#define REGISTRY_MAGIC 0x52454733u  // "REG3", bumped whenever the layout below changes
+#define REGISTRY_MAX_INSTANCES 64
+#define REGISTRY_VNODES 64          // Points of each instance on the hash ring
+#define REGISTRY_PINS (REGISTRY_MAX_INSTANCES * 65)  // 64 sessions and the cells of each instance
+
+// Kinds of state an instance keeps between requests
+#define REGISTRY_SESSION 1  // Accumulator registers, keyed by session id
+#define REGISTRY_CELLS 2    // The named cells, all under key 0
+
+typedef struct {
+    atomic_int pid;   // 0 for a free slot
+    atomic_int load;  // Requests the instance has taken and not answered yet
+} RegistrySlot;
+
+// A key whose state lives in the memory of one instance. pid 0 is a free entry
+typedef struct {
+    int pid;
+    int kind;
+    int key;
+} RegistryPin;
+
+typedef struct {
+    atomic_uint magic;
+    atomic_uint generation;  // Bumped whenever an instance joins or leaves
+    RegistrySlot slots[REGISTRY_MAX_INSTANCES];
+    atomic_int pinLock;      // PID of the process using the pins, 0 when free
+    RegistryPin pins[REGISTRY_PINS];
+} Registry;
+
+// Consistent-hash ring over the live instances, rebuilt by registryRoute when the
+// registry's generation moves. A joining or leaving instance only moves the keys next to
+// its own points
+typedef struct {
+    uint32_t point;
+    int pid;
+} RegistryPoint;
+
+typedef struct {
+    Registry *registry;
+    unsigned generation;
+    int count;
+    RegistryPoint points[REGISTRY_MAX_INSTANCES * REGISTRY_VNODES];
+} RegistryRing;
+
+// Map the registry, creating it if this is the first instance. NULL on failure
+Registry *registryOpen(void);
+
+// Claim a slot for this process, taking over slots of instances that died without leaving.
+// Returns the slot index or -1 when every slot is taken
+int registryJoin(Registry *registry);
+
+// Free the slot claimed by registryJoin and the keys this instance holds, does nothing in any
+// other process
+void registryLeave(Registry *registry, int slot);
+
+// Publish the queue depth of the instance in slot
+void registrySetLoad(Registry *registry, int slot, int load);
+
+// Spread the bits of a key before it goes on the ring
+uint32_t registryHash(uint32_t key);
+
+// PID of the instance that owns key, or -1 when no instance is running. Instances found dead
+// are dropped from the registry on the way
+int registryRoute(RegistryRing *ring, uint32_t key);
+
+// PID of the instance holding the state of key, or of the ring owner when no live instance
+// holds it yet. The ring moves keys whenever an instance joins or leaves, the state stays
+// where it was created, so an existing session or the cells never change instance while
+// their holder runs. -1 when no instance is running
+int registryRouteState(RegistryRing *ring, int kind, int key);
+
+// Record that this instance holds key, unless another live instance does. Returns the PID of
+// the holder, or -1 when every entry is taken
+int registryClaim(Registry *registry, int kind, int key);
+
+// Forget that this instance holds key, its state is gone
+void registryRelease(Registry *registry, int kind, int key);
+
+// PID of the less loaded of two instances picked at random, or -1 when no instance is
+// running. For requests that may go anywhere, no central dispatcher needed
+int registryChoose(Registry *registry);
+
+#endif
@@ -1,181 +1,1054 @@
 // Einav Haimovich - 207231721
 // Alon Horovitz - 315242248
 
+#define _GNU_SOURCE  // ppoll
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 
+#include "cache.h"
+#include "arena.h"
+#include "calc.h"
+#include "cells.h"
+#include "channel.h"
+#include "codec.h"
+#include "dag.h"
+#include "expr.h"
+#include "flight.h"
+#include "journal.h"
+#include "registry.h"
+#include "session.h"
+#include "spool.h"
+#include "uring.h"
+
 #define REQUEST_TIMEOUT_SECONDS 60
+#define VECTOR_MAX_COUNT (1 << 26)  // Operand pairs in one vector request
+
+// io_uring file transport: ring size, responses queued per flush with three entries each,
+// and the largest toServer.txt it reads (clients send at most 4096 bytes)
+#define URING_ENTRIES 256
+#define URING_BATCH 64
+#define URING_REQUEST_MAX 8192
+
+// Kinds of request that can arrive in toServer.txt
+#define REQUEST_CALCULATION 0
+#define REQUEST_EXPRESSION 1
+#define REQUEST_DAG 2
+#define REQUEST_CELL 3     // Handled by the parent, the cells must outlive the request
+#define REQUEST_SESSION 4  // Handled by the parent, like cells
+#define REQUEST_SHARED 5   // Operands in the shared arena, the request only carries offsets
+
+typedef struct {
+    int kind;
+    int clientPID;
+    int num1, operation, num2, modulus;
+    int count;               // Operand pairs of a shared-memory request
+    uint32_t operandOffset;  // Where they start in the arena
+    uint32_t resultOffset;   // Block the client allocated for the results, 0 to have the server allocate one
+    ExprProgram program;         // Copy of the compiled expression, the cache slot may change meanwhile
+    Flight *flight;              // Shared calculation the parent answers for every waiter
+    char *body;                  // Lines after the first one, inside the request buffer
+} Request;
 
 int isRequestReceived = 0;
 
-void parseInput(char *buffer, int *clientPID, int *num1, int *operation, int *num2) {
-    // Parse the input buffer and extract the values
-    char *token;
-    token = strtok(buffer, " ");
-    *clientPID = atoi(token);
+// Compiled expressions, kept by the parent so repeated expressions skip parsing. They live in
+// the cache file when it is available, so they survive a restart too
+ExprCache localExpressionCache;
+ExprCache *expressionCache = &localExpressionCache;
+
+// Named cells for incremental recomputation, also owned by the parent
+CellGraph cellGraph;
+
+// Per-session accumulator registers, so clients don't send running values back and forth
+SessionTable sessionTable;
+
+// Results shared with the clients, NULL if the cache file is unavailable
+ResultCache *resultCache;
+
+// Calculations currently computed by a child, so identical requests wait for them instead
+Flight *flights;
+
+// Payload arena shared with clients, NULL if shared memory is unavailable
+Arena *arena;
+
+// Unix socket for vector requests whose operands arrive as a memfd, -1 if unavailable
+int listenSocket = -1;
+
+// This instance's toServer_{pid}.txt inside the spool root
+char requestPath[SPOOL_PATH_MAX];
 
-    token = strtok(NULL, " ");
-    *num1 = atoi(token);
+// Instances on this host, so clients and the gateway can spread their requests over them
+Registry *registry;
+int registrySlot = -1;
 
-    token = strtok(NULL, " ");
-    *operation = atoi(token);
+// Children computing a request or serving a vector connection. With the requests waiting for
+// their commit they are this instance's queue depth, published in the registry for routing
+int activeChildren = 0;
+pid_t sweeperPID;
 
-    token = strtok(NULL, " ");
-    *num2 = atoi(token);
+// Durable request log when IPC_JOURNAL names one. Logged requests wait in awaitingCommit
+// until their group is made durable, only then are they computed
+Journal *journal;
+char *awaitingCommit[JOURNAL_GROUP];
+int awaitingCount = 0;
+struct timespec commitDeadline;
+
+// io_uring for toServer.txt and the response files when IPC_URING=1, NULL to use plain syscalls.
+// Responses written by the parent wait here until the handler that queued them flushes them
+Uring *uring;
+
+typedef struct {
+    int clientPID;
+    char path[SPOOL_PATH_MAX];
+    char *text;
+} PendingResponse;
+
+PendingResponse pendingResponses[URING_BATCH];
+int pendingCount = 0;
+
+void flushResponses(void);
+
+// A logged request is complete once it is answered, and also once answering it failed,
+// replaying it would only fail again and keep the log from starting over
+void completeRequest(int clientPID) {
+    if (journal != NULL)
+        journalComplete(journal, clientPID);
+}
+
+void publishLoad(void) {
+    if (registrySlot >= 0)
+        registrySetLoad(registry, registrySlot, activeChildren + awaitingCount);
+}
+
+int parseInput(char *buffer, int *clientPID, int *num1, int *operation, int *num2, int *modulus) {
+    // "clientPID num1 op num2 [modulus]", the modulus is only sent for the modular operations
+    int values[5] = { 0, 0, 0, 0, 0 };
+    int count = codecParseInts(buffer, buffer + strlen(buffer), values, 5);
+    if (count < 4)
+        return -1;
+
+    *clientPID = values[0];
+    *num1 = values[1];
+    *operation = values[2];
+    *num2 = values[3];
+    *modulus = values[4];
+    return 0;
 }
 
 void intToStr(int num, char *str) {
-    int i = 0, j = 0;
-    char temp[10];
+    codecFormatInt(num, str);
+}
+
+int queueResponse(int clientPID, const char *responseFile, const char *text, int flags) {
+    // open, write and close linked in order, each file goes into its own direct descriptor slot.
+    // The close is hard-linked so the slot is released even if the write fails
+    int slot = pendingCount;
+    PendingResponse *pending = &pendingResponses[slot];
+    pending->clientPID = clientPID;
+    strcpy(pending->path, responseFile);
+    pending->text = strdup(text);
+    if (pending->text == NULL) {
+        perror("ERROR_FROM_EX2\n");
+        completeRequest(clientPID);
+        return -1;
+    }
 
-    if (num == 0) {
-        str[0] = '0';
-        str[1] = '\0';
+    struct io_uring_sqe *sqe = uringEntry(uring, slot);
+    uringPrepOpen(sqe, pending->path, O_WRONLY | O_CREAT | flags, S_IRUSR | S_IWUSR, slot);
+    sqe->flags |= IOSQE_IO_LINK;
+    sqe = uringEntry(uring, slot);
+    uringPrepWrite(sqe, slot, pending->text, strlen(pending->text));
+    sqe->flags |= IOSQE_IO_HARDLINK;
+    uringPrepClose(uringEntry(uring, slot), slot);
+    pendingCount++;
+    return 0;
+}
+
+void flushResponses(void) {
+    if (uring == NULL || pendingCount == 0)
         return;
+
+    // Every queued response in one io_uring_enter, then the signals for the ones that made it
+    int failure[URING_BATCH] = { 0 };
+    if (uringSubmit(uring, 3 * pendingCount) < 0) {
+        perror("ERROR_FROM_EX2\n");
+        exit(0);
+    }
+    for (int i = 0; i < 3 * pendingCount; i++) {
+        uint64_t slot;
+        int result;
+        if (uringComplete(uring, &slot, &result) && result < 0 && failure[slot] == 0)
+            failure[slot] = result;
     }
 
-    while (num > 0) {
-        temp[i++] = (num % 10) + '0';
-        num /= 10;
+    for (int i = 0; i < pendingCount; i++) {
+        PendingResponse *pending = &pendingResponses[i];
+        free(pending->text);
+        if (failure[i] < 0) {
+            errno = -failure[i];
+            perror("ERROR_FROM_EX2\n");
+            completeRequest(pending->clientPID);
+            continue;
+        }
+        kill(pending->clientPID, SIGUSR1);
+        completeRequest(pending->clientPID);
+        printf("Server - Created response file '%s' for client with PID %d. end of stage g.\n",
+               pending->path, pending->clientPID);
     }
+    pendingCount = 0;
+}
+
+int writeResponse(int clientPID, const char *text, int flags) {
+    // Create a response file
+    char responseFile[SPOOL_PATH_MAX];
+    spoolResponsePath(clientPID, responseFile);
 
-    temp[i] = '\0';
+    // A full batch or ring is flushed first. If the ring still has no room for the three
+    // linked entries, the plain calls below write this response
+    if (uring != NULL && (pendingCount == URING_BATCH || uringSpace(uring) < 3))
+        flushResponses();
+    if (uring != NULL && uringSpace(uring) >= 3)
+        return queueResponse(clientPID, responseFile, text, flags);
 
-    for (j = 0; j < i; j++) {
-        str[j] = temp[i - j - 1];
+    int responseFD = open(responseFile, O_WRONLY | O_CREAT | flags, S_IRUSR | S_IWUSR);
+    if (responseFD < 0) {
+        perror("ERROR_FROM_EX2\n");
+        completeRequest(clientPID);
+        return -1;
     }
 
-    str[i] = '\0';
+    // Write the result to the response file
+    ssize_t bytesWritten = write(responseFD, text, strlen(text));
+    if (bytesWritten < 0) {
+        perror("ERROR_FROM_EX2\n");
+        close(responseFD);
+        completeRequest(clientPID);
+        return -1;
+    }
+
+    close(responseFD);  // Close the response file
+
+    // Send a kill signal back to the client process, a logged request is complete now
+    kill(clientPID, SIGUSR1);
+    completeRequest(clientPID);
+    printf("Server - Created response file '%s' for client with PID %d. end of stage g.\n", responseFile, clientPID);
+    return 0;
+}
+
+int sendResponse(int clientPID, const char *text) {
+    return writeResponse(clientPID, text, O_TRUNC);
+}
+
+// A request that can't be computed is still answered, the client doesn't wait for a timeout
+int sendError(int clientPID) {
+    printf("ERROR_FROM_EX2\n");
+    return sendResponse(clientPID, "ERROR_FROM_EX2");
 }
 
-void performCalculation(int clientPID, int num1, int operation, int num2) {
+// Pushed updates are appended, a watcher may not have read the previous one yet
+int pushResponse(int clientPID, const char *text) {
+    return writeResponse(clientPID, text, O_APPEND);
+}
+
+void performCalculation(int clientPID, int num1, int operation, int num2, int modulus) {
     // Perform calculation
     int result;
-    switch (operation) {
-        case 1: // Addition
-            result = num1 + num2;
-            break;
-        case 2: // Subtraction
-            result = num1 - num2;
-            break;
-        case 3: // Multiplication
-            result = num1 * num2;
-            break;
-        case 4: // Division
-            if (num2 != 0)
-                result = num1 / num2;
-            else {
-                printf("ERROR_FROM_EX2\n");
-                exit(0);
-            }
-            break;
-        default:
-            printf("ERROR_FROM_EX2\n");
+    if (computeOperation(num1, operation, num2, modulus, &result) < 0) {
+        sendError(clientPID);
+        return;
+    }
+    if (resultCache != NULL)
+        cacheInsert(resultCache, num1, operation, num2, modulus, result);
+
+    char buffer[256];
+    intToStr(result, buffer);
+    sendResponse(clientPID, buffer);
+}
+
+void computeFlight(Flight *flight) {
+    // The parent answers every waiter once this child exits, with an error if status is left unset
+    if (computeOperation(flight->num1, flight->operation, flight->num2, flight->modulus, &flight->result) < 0)
+        exit(0);
+    flight->status = 0;
+    if (resultCache != NULL)
+        cacheInsert(resultCache, flight->num1, flight->operation, flight->num2, flight->modulus, flight->result);
+}
+
+void evaluateExpression(int clientPID, const ExprProgram *program, char *bindingLines) {
+    // Every binding line is one row, an expression without variables may have none
+    int rows = 0;
+    for (char *c = bindingLines; *c; c++) {
+        if (*c == '\n')
+            rows++;
+    }
+    if (bindingLines[0] != '\0' && bindingLines[strlen(bindingLines) - 1] != '\n')
+        rows++;
+    if (rows == 0)
+        rows = 1;
+
+    int *bindings = malloc((size_t)rows * (program->varCount + 1) * sizeof(int));
+    int *results = malloc(rows * sizeof(int));
+    char *response = malloc((size_t)rows * 12 + 1);
+    if (bindings == NULL || results == NULL || response == NULL) {
+        perror("ERROR_FROM_EX2\n");
+        sendResponse(clientPID, "ERROR_FROM_EX2");
+        exit(0);
+    }
+
+    char *line = bindingLines;
+    for (int row = 0; row < rows; row++) {
+        char *next = strchr(line, '\n');
+        if (next != NULL)
+            *next = '\0';
+        if (exprBind(program, line, bindings + row * program->varCount) < 0) {
+            sendError(clientPID);
             exit(0);
+        }
+        line = next != NULL ? next + 1 : line + strlen(line);
     }
 
-    // Create a response file
-    char responseFile[64];
-    intToStr(clientPID, responseFile);
-    strcat(responseFile, "_toClient.txt");
-    int responseFD = open(responseFile, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
-    if (responseFD < 0) {
+    if (exprEvaluate(program, bindings, rows, results) < 0) {
+        sendError(clientPID);
+        exit(0);
+    }
+
+    // One result per binding row, separated by spaces
+    response[0] = '\0';
+    char *end = response;
+    for (int row = 0; row < rows; row++) {
+        if (row > 0)
+            *end++ = ' ';
+        intToStr(results[row], end);
+        end += strlen(end);
+    }
+    sendResponse(clientPID, response);
+
+    free(bindings);
+    free(results);
+    free(response);
+}
+
+void computeShared(int clientPID, int operation, int modulus, int count, uint32_t operandOffset, uint32_t resultOffset) {
+    // Operands are read in place from the arena, num1 values then num2 values
+    size_t resultSize = (size_t)count * sizeof(int);
+    const int *operands = arena != NULL && count >= 0 ? arenaPointer(arena, operandOffset, 2 * resultSize) : NULL;
+    if (operands == NULL) {
+        sendError(clientPID);
+        exit(0);
+    }
+
+    // Results go into the client's own block when it sent one, so nothing is copied or handed over
+    int isClientBlock = resultOffset != 0;
+    if (!isClientBlock)
+        resultOffset = arenaAlloc(arena, resultSize);
+    int *results = arenaPointer(arena, resultOffset, resultSize);
+    if (results == NULL) {
+        printf("ERROR_FROM_EX2 - arena exhausted\n");
+        sendResponse(clientPID, "ERROR_FROM_EX2");
+        exit(0);
+    }
+    if (computeBatch(operands, operation, operands + count, modulus, results, count) < 0) {
+        if (!isClientBlock)
+            arenaFree(arena, resultOffset);
+        sendError(clientPID);
+        exit(0);
+    }
+
+    // The response is only the offset, the client reads the results where they are and frees them
+    char response[16];
+    intToStr((int)resultOffset, response);
+    sendResponse(clientPID, response);
+}
+
+void evaluateDag(int clientPID, char *nodeLines) {
+    DagNode *nodes = malloc(DAG_MAX_NODES * sizeof(DagNode));
+    if (nodes == NULL) {
         perror("ERROR_FROM_EX2\n");
+        sendResponse(clientPID, "ERROR_FROM_EX2");
         exit(0);
     }
 
-    // Write the result to the response file
-    char buffer[256];
-    intToStr(result, buffer);
-    ssize_t bytesWritten = write(responseFD, buffer, strlen(buffer));
-    if (bytesWritten < 0) {
+    int count = dagParse(nodeLines, nodes, DAG_MAX_NODES);
+    if (count <= 0) {
+        sendError(clientPID);
+        exit(0);
+    }
+
+    int *results = malloc(count * sizeof(int));
+    char *response = malloc((size_t)count * 12 + 1);
+    if (results == NULL || response == NULL) {
         perror("ERROR_FROM_EX2\n");
+        sendResponse(clientPID, "ERROR_FROM_EX2");
+        exit(0);
+    }
+    if (dagEvaluate(nodes, count, results) < 0) {
+        sendError(clientPID);
         exit(0);
     }
 
-    close(responseFD);  // Close the response file
+    // The result of every node in request order, r1 first
+    response[0] = '\0';
+    char *end = response;
+    for (int n = 0; n < count; n++) {
+        if (n > 0)
+            *end++ = ' ';
+        intToStr(results[n], end);
+        end += strlen(end);
+    }
+    sendResponse(clientPID, response);
 
-    // Send a kill signal back to the client process
-    kill(clientPID, SIGUSR1);
-    printf("Server - Created response file '%s' for client with PID %d. end of stage g.\n", responseFile, clientPID);
+    free(nodes);
+    free(results);
+    free(response);
 }
 
-void signalHandler(int signal) {
-    if (signal == SIGUSR1) {
-        // Read the file content
-        int fd = open("toServer.txt", O_RDONLY);
-        if (fd < 0) {
-            perror("ERROR_FROM_EX2\n");
-            exit(0);
+void formatCell(const Cell *cell, char *text) {
+    strcpy(text, cell->name);
+    strcat(text, "=");
+    if (cell->isValid)
+        intToStr(cell->result, text + strlen(text));
+    else
+        strcat(text, "error");
+}
+
+// Sessions and cells stay with the instance that created them. A request for state another
+// live instance holds, sent by PID or routed before the holder claimed it, is refused rather
+// than answered from an empty copy
+int claimState(int kind, int key) {
+    if (registrySlot < 0)
+        return 0;
+    return registryClaim(registry, kind, key) == getpid() ? 0 : -1;
+}
+
+void handleCellCommand(Request *request) {
+    // "set name value", "define name a op b [modulus]", "get name" or "watch name"
+    char *tokens[7] = { NULL };
+    int tokenCount = 0;
+    for (char *token = strtok(request->body, " \n"); token != NULL && tokenCount < 7; token = strtok(NULL, " \n"))
+        tokens[tokenCount++] = token;
+    if (tokenCount < 2 || claimState(REGISTRY_CELLS, 0) < 0) {
+        sendError(request->clientPID);
+        return;
+    }
+
+    int changed[CELL_MAX];
+    int changedCount = 0;
+    int c;
+    if (strcmp(tokens[0], "set") == 0 && tokenCount == 3) {
+        changedCount = cellSet(&cellGraph, tokens[1], atoi(tokens[2]), changed);
+    } else if (strcmp(tokens[0], "define") == 0 && tokenCount >= 5) {
+        char *operands[CELL_OPERANDS] = { tokens[2], tokens[4], tokens[5] };
+        changedCount = cellDefine(&cellGraph, tokens[1], operands, atoi(tokens[3]), changed);
+    } else if (strcmp(tokens[0], "get") == 0 && (c = cellFind(&cellGraph, tokens[1])) >= 0) {
+        changed[0] = c;
+        changedCount = 1;
+    } else if (strcmp(tokens[0], "watch") == 0 && (c = cellSubscribe(&cellGraph, tokens[1], request->clientPID)) >= 0) {
+        changed[0] = c;
+        changedCount = 1;
+    } else {
+        changedCount = -1;
+    }
+    if (changedCount < 0) {
+        sendError(request->clientPID);
+        return;
+    }
+
+    // A set or define that changed nothing still answers with the cell's value
+    int pushCount = changedCount;
+    if (changedCount == 0) {
+        changed[0] = cellFind(&cellGraph, tokens[1]);
+        changedCount = 1;
+    }
+
+    // Reply with every cell whose value changed, then push them to their watchers
+    char *response = malloc((size_t)changedCount * (CELL_MAX_NAME + 16) + 1);
+    if (response == NULL) {
+        perror("ERROR_FROM_EX2\n");
+        sendResponse(request->clientPID, "ERROR_FROM_EX2");
+        return;
+    }
+    response[0] = '\0';
+    for (int i = 0; i < changedCount; i++) {
+        if (i > 0)
+            strcat(response, " ");
+        formatCell(&cellGraph.cells[changed[i]], response + strlen(response));
+    }
+    sendResponse(request->clientPID, response);
+    free(response);
+
+    if (strcmp(tokens[0], "set") != 0 && strcmp(tokens[0], "define") != 0)
+        return;
+    for (int i = 0; i < pushCount; i++) {
+        Cell *cell = &cellGraph.cells[changed[i]];
+        char update[CELL_MAX_NAME + 16];
+        formatCell(cell, update);
+        strcat(update, "\n");
+
+        for (int s = cell->subscriberCount - 1; s >= 0; s--) {
+            int subscriber = cell->subscribers[s];
+            if (kill(subscriber, 0) < 0)
+                cellUnsubscribe(&cellGraph, changed[i], subscriber);  // The watcher is gone
+            else
+                pushResponse(subscriber, update);
         }
+    }
+}
+
+void handleSessionCommand(Request *request) {
+    // "session register op [operand] [modulus]", op is "=", "+=", "-=", "*=", "/=", "get" or a code
+    char *tokens[5] = { NULL };
+    int tokenCount = 0;
+    for (char *token = strtok(request->body, " \n"); token != NULL && tokenCount < 5; token = strtok(NULL, " \n"))
+        tokens[tokenCount++] = token;
+
+    int operation = tokenCount >= 3 ? sessionOperation(tokens[2]) : -2;
+    int id = tokenCount >= 1 ? atoi(tokens[0]) : 0;
+    if (operation == -2 || (operation != SESSION_GET && tokenCount < 4) || claimState(REGISTRY_SESSION, id) < 0) {
+        sendError(request->clientPID);
+        return;
+    }
+
+    // A recycled session's registers are gone, it no longer belongs to this instance
+    Session evicted;
+    Session *session = sessionFind(&sessionTable, id, &evicted);
+    if (evicted.isUsed && registrySlot >= 0)
+        registryRelease(registry, REGISTRY_SESSION, evicted.id);
+    int operand = tokens[3] != NULL ? atoi(tokens[3]) : 0;
+    int modulus = tokens[4] != NULL ? atoi(tokens[4]) : 0;
+    int result;
+    if (sessionApply(session, atoi(tokens[1]), operation, operand, modulus, &result) < 0) {
+        sendError(request->clientPID);
+        return;
+    }
+
+    char buffer[16];
+    intToStr(result, buffer);
+    sendResponse(request->clientPID, buffer);
+}
+
+int parseRequest(char *buffer, Request *request) {
+    memset(request, 0, sizeof(*request));
+    request->clientPID = atoi(buffer);
+
+    // Named commands follow the client PID, plain calculations start with a number
+    char *command = strchr(buffer, ' ');
+    if (command != NULL && strncmp(command + 1, "expr ", 5) == 0) {
+        char *text = command + 6;
+        char *newline = strchr(text, '\n');
+        if (newline != NULL)
+            *newline = '\0';
+        request->kind = REQUEST_EXPRESSION;
+        request->body = newline != NULL ? newline + 1 : text + strlen(text);
+
+        // Compile in the parent so the program stays cached for the next request
+        return exprLookup(expressionCache, text, &request->program);
+    }
+
+    if (command != NULL && strncmp(command + 1, "dag\n", 4) == 0) {
+        request->kind = REQUEST_DAG;
+        request->body = command + 5;
+        return 0;
+    }
+
+    if (command != NULL && strncmp(command + 1, "shm ", 4) == 0) {
+        request->kind = REQUEST_SHARED;
+        request->resultOffset = 0;
+        return sscanf(command + 5, "%d %d %d %u %u", &request->operation, &request->modulus,
+                      &request->count, &request->operandOffset, &request->resultOffset) >= 4 ? 0 : -1;
+    }
+
+    if (command != NULL && strncmp(command + 1, "cell ", 5) == 0) {
+        request->kind = REQUEST_CELL;
+        request->body = command + 6;
+        return 0;
+    }
+
+    if (command != NULL && strncmp(command + 1, "acc ", 4) == 0) {
+        request->kind = REQUEST_SESSION;
+        request->body = command + 5;
+        return 0;
+    }
+
+    request->kind = REQUEST_CALCULATION;
+    return parseInput(buffer, &request->clientPID, &request->num1, &request->operation, &request->num2,
+                      &request->modulus);
+}
+
+void executeRequest(Request *request) {
+    switch (request->kind) {
+        case REQUEST_CALCULATION:
+            if (request->flight != NULL) {
+                computeFlight(request->flight);
+                break;
+            }
+            performCalculation(request->clientPID, request->num1, request->operation, request->num2, request->modulus);
+            break;
+        case REQUEST_EXPRESSION:
+            evaluateExpression(request->clientPID, &request->program, request->body);
+            break;
+        case REQUEST_DAG:
+            evaluateDag(request->clientPID, request->body);
+            break;
+        case REQUEST_SHARED:
+            computeShared(request->clientPID, request->operation, request->modulus, request->count,
+                          request->operandOffset, request->resultOffset);
+            break;
+    }
+}
+
+char *takeRequestUring(void) {
+    // open, read, close and remove toServer.txt as one linked chain, a single io_uring_enter
+    // instead of five syscalls. The file goes into the slot after the response slots
+    char *buffer = malloc(URING_REQUEST_MAX + 1);
+    if (buffer == NULL) {
+        perror("ERROR_FROM_EX2\n");
+        exit(0);
+    }
 
-        struct stat fileStat;
-        if (fstat(fd, &fileStat) < 0) {
+    struct io_uring_sqe *sqe = uringEntry(uring, 0);
+    uringPrepOpen(sqe, requestPath, O_RDONLY, 0, URING_BATCH);
+    sqe->flags |= IOSQE_IO_LINK;
+    sqe = uringEntry(uring, 1);
+    uringPrepRead(sqe, URING_BATCH, buffer, URING_REQUEST_MAX);
+    sqe->flags |= IOSQE_IO_HARDLINK;
+    sqe = uringEntry(uring, 2);
+    uringPrepClose(sqe, URING_BATCH);
+    sqe->flags |= IOSQE_IO_LINK;
+    uringPrepUnlink(uringEntry(uring, 3), requestPath);
+
+    int results[4] = { -ECANCELED, -ECANCELED, -ECANCELED, -ECANCELED };
+    if (uringSubmit(uring, 4) < 0) {
+        perror("ERROR_FROM_EX2\n");
+        exit(0);
+    }
+    for (int i = 0; i < 4; i++) {
+        uint64_t step;
+        int result;
+        if (uringComplete(uring, &step, &result))
+            results[step] = result;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        if (results[i] < 0) {
+            errno = -results[i];
             perror("ERROR_FROM_EX2\n");
-            close(fd);
+            free(buffer);
             exit(0);
         }
+    }
+    if (results[1] == URING_REQUEST_MAX) {
+        printf("ERROR_FROM_EX2 - request too long\n");
+        free(buffer);
+        exit(0);
+    }
+    buffer[results[1]] = '\0';
+    return buffer;
+}
 
-        off_t fileSize = fileStat.st_size;
-        char *buffer = malloc(fileSize + 1);
-        if (buffer == NULL) {
-            perror("ERROR_FROM_EX2\n");
-            close(fd);
-            exit(0);
+char *takeRequest(void) {
+    // The chain takes four entries, queued responses are flushed to make room and without it
+    // the plain calls take the file
+    if (uring != NULL && uringSpace(uring) < 4)
+        flushResponses();
+    if (uring != NULL && uringSpace(uring) >= 4)
+        return takeRequestUring();
+
+    // Read the file content
+    int fd = open(requestPath, O_RDONLY);
+    if (fd < 0) {
+        perror("ERROR_FROM_EX2\n");
+        exit(0);
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) < 0) {
+        perror("ERROR_FROM_EX2\n");
+        close(fd);
+        exit(0);
+    }
+
+    off_t fileSize = fileStat.st_size;
+    char *buffer = malloc(fileSize + 1);
+    if (buffer == NULL) {
+        perror("ERROR_FROM_EX2\n");
+        close(fd);
+        exit(0);
+    }
+
+    ssize_t bytesRead = read(fd, buffer, fileSize);
+    if (bytesRead < 0) {
+        perror("ERROR_FROM_EX2\n");
+        close(fd);
+        free(buffer);
+        exit(0);
+    }
+    buffer[bytesRead] = '\0';
+
+    close(fd);  // Close the file
+
+    // Remove the "toServer.txt" file
+    if (remove(requestPath) != 0) {
+        perror("ERROR_FROM_EX2\n");
+        free(buffer);
+        exit(0);
+    }
+    return buffer;
+}
+
+void dispatchRequest(char *buffer) {
+    // Parse the input
+    Request request;
+    if (parseRequest(buffer, &request) < 0) {
+        // An expression that doesn't compile lands here too, its client is waiting for an answer
+        int clientPID = atoi(buffer);
+        if (clientPID > 0) {
+            sendError(clientPID);
+        } else {
+            printf("ERROR_FROM_EX2\n");
+            completeRequest(clientPID);
         }
+        free(buffer);
+        return;
+    }
 
-        ssize_t bytesRead = read(fd, buffer, fileSize);
-        if (bytesRead < 0) {
-            perror("ERROR_FROM_EX2\n");
-            close(fd);
+    // A cached result is answered straight away, without a child
+    int cachedResult;
+    if (request.kind == REQUEST_CALCULATION && resultCache != NULL &&
+        cacheLookup(resultCache, request.num1, request.operation, request.num2, request.modulus, &cachedResult)) {
+        char response[16];
+        intToStr(cachedResult, response);
+        sendResponse(request.clientPID, response);
+        free(buffer);
+        return;
+    }
+
+    // Cell and session commands only touch the parent's state, there is nothing to fork for
+    if (request.kind == REQUEST_CELL || request.kind == REQUEST_SESSION) {
+        if (request.kind == REQUEST_CELL)
+            handleCellCommand(&request);
+        else
+            handleSessionCommand(&request);
+        free(buffer);
+        return;
+    }
+
+    // With io_uring the response joins the parent's batch, a fork would cost more than the arithmetic
+    if (request.kind == REQUEST_CALCULATION && uring != NULL) {
+        performCalculation(request.clientPID, request.num1, request.operation, request.num2, request.modulus);
+        printf("Server - performed calculation in the server process. end of stage i.\n");
+        free(buffer);
+        return;
+    }
+
+    // Identical calculations that are already running get the same answer instead of a child
+    if (request.kind == REQUEST_CALCULATION && flights != NULL) {
+        Flight *flight = flightFind(flights, request.num1, request.operation, request.num2, request.modulus);
+        if (flight != NULL && flightJoin(flight, request.clientPID) == 0) {
+            printf("Server - Client %d joined the calculation of child %d.\n", request.clientPID, flight->child);
             free(buffer);
-            exit(0);
+            return;
         }
-        buffer[bytesRead] = '\0';
+        if (flight == NULL)
+            request.flight = flightStart(flights, request.num1, request.operation, request.num2, request.modulus, request.clientPID);
+    }
 
-        close(fd);  // Close the file
+    // Fork a child process to perform the calculation
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("ERROR_FROM_EX2\n");
+        free(buffer);
+        exit(1);
+    } else if (pid == 0) {
+        // Child process, its own helpers are waited for explicitly. The ring belongs to the
+        // parent, the child writes its single response with plain syscalls
+        struct sigaction defaultAction;
+        memset(&defaultAction, 0, sizeof(defaultAction));
+        defaultAction.sa_handler = SIG_DFL;
+        sigaction(SIGCHLD, &defaultAction, NULL);
+        uring = NULL;
 
-        // Remove the "toServer.txt" file
-        if (remove("toServer.txt") != 0) {
-            perror("ERROR_FROM_EX2\n");
-            free(buffer);
-            exit(0);
+        // Perform calculation and write result to the response file
+        executeRequest(&request);
+
+        free(buffer);
+        printf("Server - performed calculation, sent the result to toClient.txt file. end of stage i.");
+        exit(0);
+    } else {
+        // Parent process
+        printf("Server - Child process created with PID: %d. end of stage f.\n", pid);
+        if (request.flight != NULL)
+            request.flight->child = pid;
+        if (journal != NULL)
+            journalSetWorker(journal, request.clientPID, pid);
+        free(buffer);  // The child is reaped by childHandler, so more requests can run meanwhile
+        activeChildren++;
+        publishLoad();
+    }
+}
+
+// Cell, session and shared-memory commands refer to state that doesn't survive a restart,
+// so only self-contained requests are logged
+int isJournaled(const char *buffer) {
+    const char *command = strchr(buffer, ' ');
+    return command == NULL || (strncmp(command + 1, "cell ", 5) != 0 && strncmp(command + 1, "acc ", 4) != 0 &&
+                               strncmp(command + 1, "shm ", 4) != 0);
+}
+
+void commitRequests(void) {
+    if (awaitingCount == 0)
+        return;
+
+    // One fdatasync for the whole group, then the requests can have effects
+    if (journalCommit(journal) < 0)
+        perror("ERROR_FROM_EX2 - journal commit failed");
+    int count = awaitingCount;
+    awaitingCount = 0;
+    for (int i = 0; i < count; i++)
+        dispatchRequest(awaitingCommit[i]);
+    publishLoad();
+}
+
+void receiveRequest(void) {
+    char *buffer = takeRequest();
+
+    // Reset the request received flag
+    isRequestReceived = 1;
+
+    if (journal == NULL || !isJournaled(buffer)) {
+        dispatchRequest(buffer);
+        return;
+    }
+    if (journalAppend(journal, buffer, atoi(buffer)) < 0) {
+        printf("ERROR_FROM_EX2 - journal full, request not logged\n");
+        dispatchRequest(buffer);
+        return;
+    }
+
+    // The first request of a group sets how long the group may wait, a full group goes now
+    if (awaitingCount == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &commitDeadline);
+        commitDeadline.tv_nsec += JOURNAL_COMMIT_USEC * 1000;
+        if (commitDeadline.tv_nsec >= 1000000000) {
+            commitDeadline.tv_sec++;
+            commitDeadline.tv_nsec -= 1000000000;
         }
+    }
+    awaitingCommit[awaitingCount++] = buffer;
+    if (awaitingCount == JOURNAL_GROUP)
+        commitRequests();
+    publishLoad();
+}
 
-        // Parse the input
-        int clientPID, num1, operation, num2;
-        parseInput(buffer, &clientPID, &num1, &operation, &num2);
+void signalHandler(int signal) {
+    if (signal == SIGUSR1)
+        receiveRequest();
 
-        // Reset the request received flag
-        isRequestReceived = 1;
+    // Responses the request queued for io_uring go out together
+    flushResponses();
+}
 
-        // Fork a child process to perform the calculation
-        pid_t pid = fork();
-        if (pid == -1) {
-            perror("ERROR_FROM_EX2\n");
-            free(buffer);
-            exit(1);
-        } else if (pid == 0) {
-            // Child process
-            // Perform calculation and write result to the response file
-            performCalculation(clientPID, num1, operation, num2);
+void answerFlight(Flight *flight) {
+    if (flight->status < 0) {
+        for (int i = 0; i < flight->waiterCount; i++)
+            sendError(flight->waiters[i]);
+        return;
+    }
 
-            free(buffer);
-            printf("Server - performed calculation, sent the result to toClient.txt file. end of stage i.");
-            exit(0);
-        } else {
-            // Parent process
-            printf("Server - Child process created with PID: %d. end of stage f.\n", pid);
-            wait(NULL);  // Wait for the child process to finish
-            free(buffer);
+    // Fan the single result out to every client that asked for it
+    char response[16];
+    intToStr(flight->result, response);
+    for (int i = 0; i < flight->waiterCount; i++)
+        sendResponse(flight->waiters[i], response);
+}
+
+void childHandler(int signal) {
+    // Reap every finished child, several exits can arrive as one signal
+    pid_t pid;
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+        Flight *flight = flights != NULL ? flightForChild(flights, pid) : NULL;
+        if (flight != NULL) {
+            answerFlight(flight);
+            flightFinish(flight);
+        }
+
+        // Whatever the child managed, its request is not retried
+        if (journal != NULL)
+            journalCompleteWorker(journal, pid);
+        if (pid != sweeperPID)
+            activeChildren--;
+    }
+    flushResponses();
+    publishLoad();
+}
+
+void streamVector(int connection, const ChannelMessage *message, const int *operands) {
+    // One chunk buffer however long the vector is, the client's credits pace the computation
+    static int chunk[CHANNEL_CHUNK_VALUES];
+    int count = message->count, credit = 0;
+    ChannelMessage reply = { CHANNEL_RESULT, message->operation, message->modulus, 0, 0 };
+
+    for (int start = 0; start < count; start += CHANNEL_CHUNK_VALUES) {
+        while (credit == 0) {
+            ChannelMessage grant;
+            int fds[CHANNEL_MAX_FDS];
+            if (channelReceive(connection, &grant, fds) != 0 || grant.kind != CHANNEL_CREDIT)
+                exit(0);  // The client went away or broke the protocol, nobody to answer
+            credit = grant.count;
+        }
+
+        int length = count - start < CHANNEL_CHUNK_VALUES ? count - start : CHANNEL_CHUNK_VALUES;
+        if (computeBatch(operands + start, message->operation, operands + count + start, message->modulus,
+                         chunk, length) < 0) {
+            reply.status = -1;
+            break;
         }
+
+        ChannelMessage header = { CHANNEL_CHUNK, message->operation, message->modulus, length, 0 };
+        if (channelSend(connection, &header, NULL, 0) < 0 ||
+            channelSendData(connection, chunk, (size_t)length * sizeof(int)) < 0)
+            exit(0);
+        reply.count += length;
+        credit--;
     }
+
+    // The closing message tells the client how many values it should have and whether all were valid
+    channelSend(connection, &reply, NULL, 0);
+    printf("Server - Streamed %d vector results to a socket client.\n", (int)reply.count);
+}
+
+void serveVector(int connection) {
+    ChannelMessage message;
+    int fds[CHANNEL_MAX_FDS];
+    int fdCount = channelReceive(connection, &message, fds);
+    int expected = message.kind == CHANNEL_VECTOR_INTO ? 2 : 1;
+    if (fdCount != expected || message.count > VECTOR_MAX_COUNT ||
+        (message.kind != CHANNEL_VECTOR && message.kind != CHANNEL_VECTOR_INTO && message.kind != CHANNEL_STREAM)) {
+        printf("ERROR_FROM_EX2\n");
+        exit(0);
+    }
+
+    // Compute straight from the client's pages, num1 values first and num2 values after them
+    int count = message.count;
+    const int *operands = channelMapPayload(fds[0], 2 * (size_t)count * sizeof(int));
+    if (operands == NULL) {
+        printf("ERROR_FROM_EX2\n");
+        exit(0);
+    }
+    if (message.kind == CHANNEL_STREAM) {
+        streamVector(connection, &message, operands);
+        return;
+    }
+
+    // A client that sent a destination gets its results written in place, nothing to send back
+    void *results;
+    size_t resultSize = (size_t)count * sizeof(int);
+    int resultFD = -1;
+    if (message.kind == CHANNEL_VECTOR_INTO)
+        results = channelMapDestination(fds[1], resultSize);
+    else
+        resultFD = channelCreatePayload("calc_results", resultSize, &results);
+    if (results == NULL || (message.kind == CHANNEL_VECTOR && resultFD < 0)) {
+        perror("ERROR_FROM_EX2\n");
+        exit(0);
+    }
+
+    ChannelMessage reply = { CHANNEL_RESULT, message.operation, message.modulus, message.count, 0 };
+    reply.status = computeBatch(operands, message.operation, operands + count, message.modulus, results, count);
+
+    // Otherwise the results go back the same way, as a sealed memfd the client maps
+    if (resultFD >= 0 && channelSealPayload(resultFD, results, resultSize) < 0) {
+        perror("ERROR_FROM_EX2\n");
+        exit(0);
+    }
+    if (channelSend(connection, &reply, &resultFD, resultFD >= 0 ? 1 : 0) < 0) {
+        perror("ERROR_FROM_EX2\n");
+        exit(0);
+    }
+    printf("Server - Sent %d vector results to a socket client.\n", count);
+}
+
+void serveConnection(int connection) {
+    isRequestReceived = 1;
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("ERROR_FROM_EX2\n");
+    } else if (pid == 0) {
+        struct sigaction defaultAction;
+        memset(&defaultAction, 0, sizeof(defaultAction));
+        defaultAction.sa_handler = SIG_DFL;
+        sigaction(SIGCHLD, &defaultAction, NULL);
+        uring = NULL;
+
+        close(listenSocket);
+        serveVector(connection);
+        exit(0);
+    }
+    close(connection);
+    if (pid > 0) {
+        activeChildren++;
+        publishLoad();
+    }
+}
+
+void startSweeper(void) {
+    // A helper process that wakes up now and then to delete the response files of clients
+    // that died before reading them. It goes away with the server
+    pid_t serverPID = getpid();
+    pid_t pid = fork();
+    if (pid != 0) {
+        if (pid < 0)
+            perror("ERROR_FROM_EX2 - spool sweeper unavailable");
+        sweeperPID = pid;
+        return;
+    }
+
+    struct sigaction defaultAction;
+    memset(&defaultAction, 0, sizeof(defaultAction));
+    defaultAction.sa_handler = SIG_DFL;
+    sigaction(SIGTERM, &defaultAction, NULL);
+    sigaction(SIGINT, &defaultAction, NULL);
+    sigaction(SIGCHLD, &defaultAction, NULL);
+    defaultAction.sa_handler = SIG_IGN;
+    sigaction(SIGUSR1, &defaultAction, NULL);  // Requests are for the server, not for us
+    uring = NULL;
+    if (listenSocket >= 0)
+        close(listenSocket);
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+    while (getppid() == serverPID) {
+        int removed = spoolSweep();
+        if (removed > 0)
+            printf("Server - Swept %d orphaned response files.\n", removed);
+        sleep(SPOOL_SWEEP_SECONDS);
+    }
+    _exit(0);
+}
+
+void removeSocket(void) {
+    char path[CHANNEL_PATH_MAX];
+    channelPath(getpid(), path);
+    unlink(path);
+}
+
+void leaveRegistry(void) {
+    registryLeave(registry, registrySlot);
+}
+
+void terminationHandler(int signal) {
+    // Exit normally so the socket and the arena are removed by their atexit handlers
+    exit(0);
 }
 
 void timerHandler(int signal) {
@@ -186,15 +1059,143 @@ void timerHandler(int signal) {
 }
 
 int main() {
-    // Set up signal handler for SIGUSR1
-    signal(SIGUSR1, signalHandler);
+    // Attach the cache file left by the previous run, the server still works without it
+    resultCache = cacheOpen(1);
+    if (resultCache == NULL)
+        perror("ERROR_FROM_EX2 - result cache unavailable");
+
+    // The request file and the response files live under the spool root, with nowhere to put
+    // them no client could reach the server
+    if (spoolCreate() < 0) {
+        perror("ERROR_FROM_EX2 - spool directory unavailable, " SPOOL_ROOT_ENV " must be an absolute path");
+        exit(1);
+    }
+    spoolRequestPath(getpid(), requestPath);
+
+    // The io_uring file transport is opt-in, without kernel support the plain syscalls are used
+    char *useUring = getenv("IPC_URING");
+    if (useUring != NULL && strcmp(useUring, "1") == 0) {
+        uring = uringCreate(URING_ENTRIES, URING_BATCH + 1);
+        if (uring == NULL)
+            perror("ERROR_FROM_EX2 - io_uring unavailable, using plain file calls");
+    }
+
+    // Durable request log, opt-in through IPC_JOURNAL
+    journal = journalOpen();
+    if (journal == NULL && getenv(JOURNAL_ENV) != NULL) {
+        if (errno == EBUSY) {
+            printf("ERROR_FROM_EX2 - journal %s is used by another server, each instance needs its own\n",
+                   getenv(JOURNAL_ENV));
+            exit(1);
+        }
+        perror("ERROR_FROM_EX2 - journal unavailable, requests are not logged");
+    }
+
+    flights = flightTableCreate();
+    if (flights == NULL)
+        perror("ERROR_FROM_EX2 - request deduplication unavailable");
+
+    // Set up signal handlers for SIGUSR1 and SIGCHLD, each blocks the other
+    // since both update the flight table
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    sigaddset(&action.sa_mask, SIGUSR1);
+    sigaddset(&action.sa_mask, SIGCHLD);
+    action.sa_flags = SA_RESTART;
+    action.sa_handler = signalHandler;
+    sigaction(SIGUSR1, &action, NULL);
+    action.sa_handler = childHandler;
+    sigaction(SIGCHLD, &action, NULL);
+
+    signal(SIGTERM, terminationHandler);
+    signal(SIGINT, terminationHandler);
 
     // Set up timer handler for request timeout
     signal(SIGALRM, timerHandler);
     alarm(REQUEST_TIMEOUT_SECONDS);
 
+    arena = arenaCreate();
+    if (arena == NULL)
+        perror("ERROR_FROM_EX2 - shared arena unavailable");
+    else
+        atexit(arenaRemove);
+
+    listenSocket = channelListen();
+    if (listenSocket < 0)
+        perror("ERROR_FROM_EX2 - vector socket unavailable");
+    else
+        atexit(removeSocket);
+
+    startSweeper();
+
+    // Only join once requests can be handled, clients start routing to us right away
+    registry = registryOpen();
+    if (registry != NULL)
+        registrySlot = registryJoin(registry);
+    if (registrySlot < 0)
+        perror("ERROR_FROM_EX2 - instance registry unavailable, only reachable by PID");
+    else
+        atexit(leaveRegistry);
+
+    // The compiled expressions in the cache file have a single writer, the instance in the
+    // first slot. Any other instance keeps its own in memory
+    if (resultCache != NULL && registrySlot <= 0) {
+        expressionCache = &resultCache->expressions;
+        exprCacheValidate(expressionCache);
+    }
+
+    // Requests left pending by a crash are computed again before new ones arrive
+    if (journal != NULL) {
+        sigset_t blocked, previous;
+        sigemptyset(&blocked);
+        sigaddset(&blocked, SIGUSR1);
+        sigaddset(&blocked, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &blocked, &previous);
+        int stale = journalReplay(journal, dispatchRequest);
+        if (stale > 0)
+            printf("Server - Dropped %d logged requests of clients that are gone.\n", stale);
+        flushResponses();
+        sigprocmask(SIG_SETMASK, &previous, NULL);
+    }
+
+    // Signals interrupt the poll, the socket brings vector requests. The handlers stay blocked
+    // outside ppoll so a group waiting for its commit is never missed
+    sigset_t blocked, waiting;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGUSR1);
+    sigaddset(&blocked, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &blocked, &waiting);
+    sigdelset(&waiting, SIGUSR1);
+    sigdelset(&waiting, SIGCHLD);
     while (1) {
-        pause();
+        struct timespec timeout, now;
+        struct timespec *deadline = NULL;
+        if (awaitingCount > 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long nanoseconds = (commitDeadline.tv_sec - now.tv_sec) * 1000000000L + commitDeadline.tv_nsec - now.tv_nsec;
+            if (nanoseconds <= 0) {
+                commitRequests();
+                flushResponses();
+                continue;
+            }
+            timeout.tv_sec = nanoseconds / 1000000000L;
+            timeout.tv_nsec = nanoseconds % 1000000000L;
+            deadline = &timeout;
+        }
+
+        struct pollfd listener = { listenSocket, POLLIN, 0 };
+        if (ppoll(&listener, listenSocket < 0 ? 0 : 1, deadline, &waiting) <= 0)
+            continue;
+
+        int connection = accept(listenSocket, NULL, NULL);
+        if (connection >= 0)
+            serveConnection(connection);
+
+        // ppoll only runs the handlers when it is interrupted, under a steady stream of
+        // connections the exited children would never be reaped. Let them in here
+        sigprocmask(SIG_SETMASK, &waiting, NULL);
+        sigprocmask(SIG_BLOCK, &blocked, NULL);
     }
 
     return 0;
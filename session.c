@@ -0,0 +1,63 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "calc.h"
+#include "session.h"
+
+Session *sessionFind(SessionTable *table, int id, Session *evicted) {
+    Session *victim = NULL;
+
+    evicted->isUsed = 0;
+    for (int i = 0; i < SESSION_MAX; i++) {
+        Session *slot = &table->slots[i];
+        if (slot->isUsed && slot->id == id) {
+            slot->lastUsed = time(NULL);
+            return slot;
+        }
+        if (victim == NULL || !slot->isUsed || (victim->isUsed && slot->lastUsed < victim->lastUsed))
+            victim = slot;
+    }
+
+    // New sessions start with zeroed registers
+    *evicted = *victim;
+    memset(victim, 0, sizeof(*victim));
+    victim->id = id;
+    victim->isUsed = 1;
+    victim->lastUsed = time(NULL);
+    return victim;
+}
+
+int sessionOperation(const char *text) {
+    if (strcmp(text, "=") == 0)
+        return SESSION_SET;
+    if (strcmp(text, "get") == 0)
+        return SESSION_GET;
+    if (strcmp(text, "+=") == 0)
+        return OP_ADD;
+    if (strcmp(text, "-=") == 0)
+        return OP_SUB;
+    if (strcmp(text, "*=") == 0)
+        return OP_MUL;
+    if (strcmp(text, "/=") == 0)
+        return OP_DIV;
+
+    int operation = atoi(text);
+    return operation >= OP_ADD && operation <= OP_POWMOD ? operation : -2;
+}
+
+int sessionApply(Session *session, int reg, int operation, int operand, int modulus, int *result) {
+    if (reg < 0 || reg >= SESSION_REGISTERS)
+        return -1;
+
+    int *accumulator = &session->registers[reg];
+    if (operation == SESSION_SET)
+        *accumulator = operand;
+    else if (operation != SESSION_GET && computeOperation(*accumulator, operation, operand, modulus, accumulator) < 0)
+        return -1;
+
+    *result = *accumulator;
+    return 0;
+}
@@ -0,0 +1,38 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <time.h>
+
+#define SESSION_MAX 64
+#define SESSION_REGISTERS 8
+
+// Accumulator operations beyond the calculation codes
+#define SESSION_SET 0   // acc = x
+#define SESSION_GET -1  // read acc
+
+// One client session slot: its registers stay in the server between requests
+typedef struct {
+    int id;
+    int isUsed;
+    time_t lastUsed;
+    int registers[SESSION_REGISTERS];
+} Session;
+
+typedef struct {
+    Session slots[SESSION_MAX];
+} SessionTable;
+
+// Find the slot of a session, claiming a free or the least recently used one for a new id.
+// The session recycled to make room is copied to evicted, whose isUsed is 0 if there was none
+Session *sessionFind(SessionTable *table, int id, Session *evicted);
+
+// Map "=", "+=", "-=", "*=", "/=", "get" or a numeric operation code to an operation, -2 if unknown
+int sessionOperation(const char *text);
+
+// acc = acc op operand, returns 0 with the new value in result or -1 on an invalid operation
+int sessionApply(Session *session, int reg, int operation, int operand, int modulus, int *result);
+
+#endif
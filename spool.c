@@ -0,0 +1,89 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "spool.h"
+
+const char *spoolRoot(void) {
+    // Decided once per process, every path below is built from it
+    static const char *root;
+    if (root != NULL)
+        return root;
+
+    root = getenv(SPOOL_ROOT_ENV);
+    if (root == NULL || root[0] == '\0') {
+        struct stat shmStat;
+        root = stat("/dev/shm", &shmStat) == 0 && S_ISDIR(shmStat.st_mode) ? SPOOL_ROOT_DEFAULT : SPOOL_ROOT_FALLBACK;
+    }
+    return root;
+}
+
+// Consecutive PIDs land in different buckets
+static unsigned bucketOf(int pid) {
+    return ((uint32_t)pid * 2654435761u) >> 24;
+}
+
+int spoolCreate(void) {
+    char path[SPOOL_PATH_MAX];
+    const char *root = spoolRoot();
+    if (root[0] != '/') {
+        errno = EINVAL;
+        return -1;
+    }
+    if (mkdir(root, 0755) < 0 && errno != EEXIST)
+        return -1;
+
+    for (unsigned bucket = 0; bucket < SPOOL_BUCKETS; bucket++) {
+        snprintf(path, sizeof(path), "%s/%02x", root, bucket);
+        if (mkdir(path, 0755) < 0 && errno != EEXIST)
+            return -1;
+    }
+    return 0;
+}
+
+void spoolRequestPath(int serverPID, char *path) {
+    snprintf(path, SPOOL_PATH_MAX, "%s/toServer_%d.txt", spoolRoot(), serverPID);
+}
+
+void spoolResponsePath(int pid, char *path) {
+    snprintf(path, SPOOL_PATH_MAX, "%s/%02x/%d_toClient.txt", spoolRoot(), bucketOf(pid), pid);
+}
+
+int spoolSweep(void) {
+    char path[SPOOL_PATH_MAX];
+    const char *root = spoolRoot();
+    int removed = 0;
+
+    for (unsigned bucket = 0; bucket < SPOOL_BUCKETS; bucket++) {
+        snprintf(path, sizeof(path), "%s/%02x", root, bucket);
+        DIR *directory = opendir(path);
+        if (directory == NULL)
+            continue;
+
+        // "{pid}_toClient.txt" and the ".taken" copies of watchers, both named after the client
+        struct dirent *entry;
+        while ((entry = readdir(directory)) != NULL) {
+            char *end;
+            long pid = strtol(entry->d_name, &end, 10);
+            if (end == entry->d_name || strncmp(end, "_toClient.txt", 13) != 0 || pid <= 0)
+                continue;
+            if (kill((pid_t)pid, 0) == 0 || errno != ESRCH)
+                continue;  // Still running, or running as someone we may not signal
+
+            snprintf(path, sizeof(path), "%s/%02x/%s", root, bucket, entry->d_name);
+            if (unlink(path) == 0)
+                removed++;
+        }
+        closedir(directory);
+    }
+    return removed;
+}
@@ -0,0 +1,31 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#ifndef SPOOL_H
+#define SPOOL_H
+
+// Where the request files and the response files live. Response files are spread over hashed
+// subdirectories so no single directory holds every client's file. The root is an absolute
+// path, so a client started from another directory still finds the server's files
+#define SPOOL_ROOT_ENV "IPC_SPOOL_DIR"
+#define SPOOL_ROOT_DEFAULT "/dev/shm/ipc_calc"  // tmpfs, the files never need to reach a disk
+#define SPOOL_ROOT_FALLBACK "/tmp/ipc_calc"     // Used when /dev/shm is missing
+#define SPOOL_BUCKETS 256
+#define SPOOL_PATH_MAX 512
+
+// Seconds between sweeps for response files of clients that are gone
+#define SPOOL_SWEEP_SECONDS 30
+
+const char *spoolRoot(void);
+
+// Create the root and its subdirectories, returns -1 on failure or with a relative root
+int spoolCreate(void);
+
+// Each server instance has its own request file, "toServer_{serverPID}.txt"
+void spoolRequestPath(int serverPID, char *path);
+void spoolResponsePath(int pid, char *path);
+
+// Remove the response files whose client process no longer exists, returns how many
+int spoolSweep(void);
+
+#endif
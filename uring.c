@@ -0,0 +1,189 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+
+static int uringSetup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int uringRegister(int fd, unsigned opcode, const void *argument, unsigned count) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, argument, count);
+}
+
+Uring *uringCreate(unsigned entries, unsigned files) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = uringSetup(entries, &params);
+    if (fd < 0)
+        return NULL;
+
+    Uring *ring = calloc(1, sizeof(Uring));
+    if (ring == NULL || (params.features & IORING_FEAT_SINGLE_MMAP) == 0) {
+        free(ring);
+        close(fd);
+        return NULL;
+    }
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+
+    // Submission and completion rings share one mapping, the entries array is a second one
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ringsSize = sqSize > cqSize ? sqSize : cqSize;
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->rings = mmap(NULL, ring->ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->rings == MAP_FAILED || ring->sqes == MAP_FAILED)
+        goto fail;
+
+    char *base = ring->rings;
+    ring->sqHead = (unsigned *)(base + params.sq_off.head);
+    ring->sqTail = (unsigned *)(base + params.sq_off.tail);
+    ring->sqMask = (unsigned *)(base + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *)(base + params.sq_off.array);
+    ring->cqHead = (unsigned *)(base + params.cq_off.head);
+    ring->cqTail = (unsigned *)(base + params.cq_off.tail);
+    ring->cqMask = (unsigned *)(base + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(base + params.cq_off.cqes);
+
+    // Empty slots for direct descriptors, opens fill them and closes free them again
+    int *slots = malloc(files * sizeof(int));
+    if (slots == NULL)
+        goto fail;
+    for (unsigned i = 0; i < files; i++)
+        slots[i] = -1;
+    int registered = uringRegister(fd, IORING_REGISTER_FILES, slots, files);
+    free(slots);
+    if (registered < 0)
+        goto fail;
+    return ring;
+
+fail:
+    if (ring->rings != NULL && ring->rings != MAP_FAILED)
+        munmap(ring->rings, ring->ringsSize);
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqesSize);
+    close(fd);
+    free(ring);
+    return NULL;
+}
+
+int uringSetFile(Uring *ring, unsigned slot, int fd) {
+    struct io_uring_files_update update;
+    memset(&update, 0, sizeof(update));
+    update.offset = slot;
+    update.fds = (uintptr_t)&fd;
+    return uringRegister(ring->fd, IORING_REGISTER_FILES_UPDATE, &update, 1) == 1 ? 0 : -1;
+}
+
+struct io_uring_sqe *uringEntry(Uring *ring, uint64_t userData) {
+    unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sqTail + ring->queued;
+    if (tail - head >= ring->entries)
+        return NULL;
+
+    unsigned index = tail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = userData;
+    ring->sqArray[index] = index;
+    ring->queued++;
+    return sqe;
+}
+
+unsigned uringSpace(Uring *ring) {
+    unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+    return ring->entries - (*ring->sqTail + ring->queued - head);
+}
+
+void uringPrepOpen(struct io_uring_sqe *sqe, const char *path, int flags, mode_t mode, unsigned slot) {
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uintptr_t)path;
+    sqe->open_flags = flags;
+    sqe->len = mode;
+    sqe->file_index = slot + 1;  // 0 means a regular descriptor
+}
+
+void uringPrepRead(struct io_uring_sqe *sqe, unsigned slot, void *buffer, unsigned length) {
+    sqe->opcode = IORING_OP_READ;
+    sqe->flags |= IOSQE_FIXED_FILE;
+    sqe->fd = slot;
+    sqe->addr = (uintptr_t)buffer;
+    sqe->len = length;
+    sqe->off = (uint64_t)-1;  // Current file position, like read()
+}
+
+void uringPrepWrite(struct io_uring_sqe *sqe, unsigned slot, const void *buffer, unsigned length) {
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->flags |= IOSQE_FIXED_FILE;
+    sqe->fd = slot;
+    sqe->addr = (uintptr_t)buffer;
+    sqe->len = length;
+    sqe->off = (uint64_t)-1;  // Current position, so O_APPEND appends
+}
+
+void uringPrepReadAt(struct io_uring_sqe *sqe, unsigned slot, void *buffer, unsigned length, uint64_t offset) {
+    uringPrepRead(sqe, slot, buffer, length);
+    sqe->off = offset;
+}
+
+void uringPrepWriteAt(struct io_uring_sqe *sqe, unsigned slot, const void *buffer, unsigned length, uint64_t offset) {
+    uringPrepWrite(sqe, slot, buffer, length);
+    sqe->off = offset;
+}
+
+void uringPrepClose(struct io_uring_sqe *sqe, unsigned slot) {
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = slot + 1;
+}
+
+void uringPrepUnlink(struct io_uring_sqe *sqe, const char *path) {
+    sqe->opcode = IORING_OP_UNLINKAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uintptr_t)path;
+}
+
+int uringSubmit(Uring *ring, unsigned waitFor) {
+    __atomic_store_n(ring->sqTail, *ring->sqTail + ring->queued, __ATOMIC_RELEASE);
+    unsigned toSubmit = ring->queued;
+    ring->queued = 0;
+
+    while (1) {
+        unsigned ready = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE) - *ring->cqHead;
+        if (toSubmit == 0 && ready >= waitFor)
+            return 0;
+
+        int submitted = uringEnter(ring->fd, toSubmit, waitFor > ready ? waitFor - ready : 0,
+                                   IORING_ENTER_GETEVENTS);
+        if (submitted < 0 && errno != EINTR)
+            return -1;
+        if (submitted > 0)
+            toSubmit -= submitted;
+    }
+}
+
+int uringComplete(Uring *ring, uint64_t *userData, int *result) {
+    unsigned head = *ring->cqHead;
+    if (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))
+        return 0;
+
+    struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+    *userData = cqe->user_data;
+    *result = cqe->res;
+    __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
@@ -0,0 +1,55 @@
+// Einav Haimovich - 207231721
+// Alon Horovitz - 315242248
+
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <linux/io_uring.h>
+
+// Minimal io_uring on raw syscalls, for batching the file transport's open/read/write/close/unlink.
+// Files are opened as direct descriptors into registered slots, so they never enter the fd table
+
+typedef struct {
+    int fd;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned entries;
+    unsigned queued;  // Entries filled since the last submit
+    void *rings;
+    size_t ringsSize, sqesSize;
+} Uring;
+
+// Set up a ring with entries slots and files registered direct descriptor slots, returns NULL
+// if the kernel has no io_uring or it is disabled
+Uring *uringCreate(unsigned entries, unsigned files);
+
+// Put an already open descriptor into a registered slot, returns -1 on failure
+int uringSetFile(Uring *ring, unsigned slot, int fd);
+
+// Next free submission entry, zeroed, or NULL when the ring is full
+struct io_uring_sqe *uringEntry(Uring *ring, uint64_t userData);
+
+// Number of submission entries uringEntry can still hand out before the next submit
+unsigned uringSpace(Uring *ring);
+
+void uringPrepOpen(struct io_uring_sqe *sqe, const char *path, int flags, mode_t mode, unsigned slot);
+void uringPrepRead(struct io_uring_sqe *sqe, unsigned slot, void *buffer, unsigned length);
+void uringPrepWrite(struct io_uring_sqe *sqe, unsigned slot, const void *buffer, unsigned length);
+// Same at an explicit file offset, for reading and writing several blocks of one file at once
+void uringPrepReadAt(struct io_uring_sqe *sqe, unsigned slot, void *buffer, unsigned length, uint64_t offset);
+void uringPrepWriteAt(struct io_uring_sqe *sqe, unsigned slot, const void *buffer, unsigned length, uint64_t offset);
+void uringPrepClose(struct io_uring_sqe *sqe, unsigned slot);
+void uringPrepUnlink(struct io_uring_sqe *sqe, const char *path);
+
+// Submit everything queued and wait for at least waitFor completions, one io_uring_enter.
+// Returns -1 on failure
+int uringSubmit(Uring *ring, unsigned waitFor);
+
+// Pop one completion, returns 0 if there is none
+int uringComplete(Uring *ring, uint64_t *userData, int *result);
+
+#endif